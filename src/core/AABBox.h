@@ -48,6 +48,13 @@ struct BBox {
     /// slab method
     /// source https://github.com/mmp/pbrt-v3/blob/master/src/core/geometry.h
     bool intersect(const Ray& ray) const {
+        float t0, t1;
+        return intersect(ray, &t0, &t1);
+    }
+
+    /// @brief Verifies if ray intersects with the box and records the parametric range
+    /// [_hitT0_, _hitT1_] of the ray that overlaps with the box
+    bool intersect(const Ray& ray, float* hitT0, float* hitT1) const {
         float t0 = 0, t1 = MAX_FLOAT;
         for (int i = 0; i < 3; i++) {
             float invRayDir = 1 / ray.dir[i];
@@ -66,6 +73,8 @@ struct BBox {
             }
         }
 
+        *hitT0 = t0;
+        *hitT1 = t1;
         return true;
     }
 };
@@ -88,6 +97,12 @@ inline static bool boxIntersect(const BBox& boxA, const BBox& boxB) {
     return true;
 }
 
+/// @brief Computes the surface area of _box_
+inline static float surfaceArea(const BBox& box) {
+    const Vector3f diagonal = box.max - box.min;
+    return 2 * (diagonal.x * diagonal.y + diagonal.x * diagonal.z + diagonal.y * diagonal.z);
+}
+
 /// @brief Finds the longest axis of _box_
 inline static int32_t findMaxExtent(const BBox& box) {
     const Vector3f boxDiagonal = box.max - box.min;
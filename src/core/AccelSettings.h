@@ -0,0 +1,56 @@
+#ifndef ACCELSETTINGS_H
+#define ACCELSETTINGS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Defines.h"
+#include "Matrix3x3.h"
+
+/// @brief Acceleration structures available for the scene's triangles. _BVH4_ and _BVH8_ are the
+/// binary BVH collapsed to 4 and 8 children per node
+enum class AccelStructure { KdTree, BVH, BVH4, BVH8 };
+
+/// @brief Methods for choosing the split planes of the tree. _SAH_ sorts the candidates along all
+/// three axes of each node, while _EventSAH_ sorts the split events of all three axes once and
+/// passes them down the recursion (Wald & Havran), building the tree in O(N log N)
+enum class SplitMethod { Middle, SAH, EventSAH };
+
+/// @brief Build settings of the acceleration tree, adjustable per scene
+struct AccelTreeSettings {
+    SplitMethod splitMethod = SplitMethod::EventSAH;  ///< Method for choosing the split planes
+    float traversalCost = 1.f;  ///< Cost of traversing interior node in the SAH cost model
+    float isectCost = 80.f;     ///< Cost of ray-triangle intersection in the SAH cost model
+    float emptyBonus = 0.5f;    ///< Cost reduction in [0, 1] for splits that cut off empty space
+    int32_t maxLeafTriangles = (int32_t)MAX_TRIANGLES_PER_NODE;  ///< Max triangles in a leaf
+    int32_t maxDepth = MAX_TREE_DEPTH;  ///< Maximum depth of the tree, capped by MAX_TREE_DEPTH
+    int32_t maxBadRefines = 2;          ///< Tolerated splits per path that cost more than a leaf
+    bool perfectSplits = false;  ///< Clip straddling triangles to children boxes, EventSAH only
+    std::string cacheFile;  ///< File that caches the built tree between runs, disabled if empty
+};
+
+/// @brief Algorithms that build the BVH. _LBVH_ orders the primitives along a Morton curve and
+/// builds much faster than the binned _SAH_ builder at the cost of lower tree quality
+enum class BVHBuilder { SAH, LBVH };
+
+/// @brief Build settings of the BVH, adjustable per scene
+struct BVHSettings {
+    BVHBuilder builder = BVHBuilder::SAH;  ///< Algorithm that builds the hierarchy
+    bool optimizeTreelets = true;          ///< LBVH builds the levels above its treelets by SAH
+    int32_t numBins = 12;                  ///< Number of bins along the split axis
+    int32_t maxLeafTriangles = 4;          ///< Nodes with more triangles are always split
+    float traversalCost = 0.125f;          ///< Cost of traversing interior node in the SAH model
+    float isectCost = 1.f;                 ///< Cost of ray-triangle intersection in the SAH model
+    float rebuildThreshold = 1.5f;         ///< Growth of the SAH cost that rebuilds a refit BVH
+};
+
+/// @brief Placement of a scene mesh in world space. The mesh's points are transformed as row
+/// vectors, p * transform + translation, like the camera's rotation matrix
+struct MeshInstance {
+    int32_t meshIdx = 0;        ///< Index of the instanced mesh in the scene's objects
+    Matrix3x3 transform{1.f};   ///< Object to world rotation and scale
+    Vector3f translation{0.f};  ///< Object to world translation
+    int32_t materialIdx = -1;   ///< Material replacing the mesh's one, negative keeps the mesh's
+};
+
+#endif  // !ACCELSETTINGS_H
@@ -1,18 +1,37 @@
 /// Own includes
 #include "AccelerationTree.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
 #include "Timer.h"
 
 /// System headers
 #include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <stack>
 
-struct NodeIndexBBoxPair {
+/// @brief Node scheduled for traversal along with the parametric range of the ray inside it
+struct NodeTraversalRange {
     int32_t nodeIdx;
-    BBox nodeBBox;
+    float tMin;
+    float tMax;
 };
 
+/// @brief Header of the tree cache file, followed by the nodes and the leaf triangle indices
+struct AccelTreeCacheHeader {
+    char magic[8];            ///< Identifies the file as tree cache
+    uint32_t version;         ///< Version of the cache format
+    uint32_t nodeSize;        ///< Size of the stored nodes in bytes
+    uint64_t key;             ///< Hash of the triangles and the build settings of the tree
+    uint64_t numTriangles;    ///< Number of triangles the tree is built over
+    uint64_t numNodes;        ///< Number of stored nodes
+    uint64_t numLeafIndices;  ///< Number of stored leaf triangle indices
+};
+
+static constexpr char ACCEL_TREE_CACHE_MAGIC[8] = "CRTKDTR";
+
 struct PrimBounds {
     enum BoundType { Min, Max };
 
@@ -20,275 +39,843 @@ struct PrimBounds {
     BoundType type;
 };
 
-AccelTree::Node::Node(const int32_t _parentId, const int8_t _splitAxis, const NodeType _nodeType,
-                      const NodeParams _nodeParams)
-    : parentId(_parentId), splitAxis(_splitAxis), type(_nodeType) {
-    if (type == Interior) {
-        params.children[0] = _nodeParams.children[0];
-        params.children[1] = _nodeParams.children[1];
-    } else
-        params.nodeTriangles = _nodeParams.nodeTriangles;
-};
+bool AccelTree::intersectLeaf(const Node& leaf, const TriangleIntersector& intersector,
+                              Mailbox<MAILBOX_SIZE>& mailbox, TriangleHit& closestHit) const {
+    bool hasCloserHit = false;
+    const int32_t* leafIndices = &leafTriangleIndices[leaf.primsOffset()];
+    const TrianglePacket* packets = &leafPackets[leaf.primsOffset() / TRIANGLE_PACKET_WIDTH];
+    for (int32_t first = 0; first < leaf.numPrims(); first += TRIANGLE_PACKET_WIDTH) {
+        // a triangle straddling a split is referenced by several leaves, its closest hit is
+        // already recorded when the ray reached one of them before
+        const int32_t activeLanes = testPacketMailbox(leafIndices + first,
+                                                      leaf.numPrims() - first, mailbox);
+        if (!activeLanes)
+            continue;
 
-bool AccelTree::Node::intersect(const Ray& ray, Intersection& isectData) const {
-    Intersection closestPrim;
-    bool hasIntersect = false;
-    if (params.nodeTriangles->size() > 0) {
-        const auto nodeTriangles = params.nodeTriangles;
-        for (auto it = nodeTriangles->begin(); it != nodeTriangles->end(); ++it) {
-            if (it->intersectMT(ray, isectData)) {
-                if (isectData.t < closestPrim.t)
-                    closestPrim = isectData;
-                hasIntersect = true;
+        const TrianglePacket& packet = packets[first / TRIANGLE_PACKET_WIDTH];
+        PacketHits hits;
+        const int32_t hitLanes = intersectPacket(packet, intersector, activeLanes, hits);
+        for (int32_t lane = 0; lane < TRIANGLE_PACKET_WIDTH; lane++) {
+            if ((hitLanes & (1 << lane)) && hits.t[lane] < closestHit.t) {
+                closestHit = {hits.t[lane], hits.u[lane], hits.v[lane],
+                              leaf.primsOffset() + first + lane};
+                hasCloserHit = true;
             }
         }
     }
 
-    if (hasIntersect)
-        isectData = closestPrim;
-
-    return hasIntersect;
+    return hasCloserHit;
 }
 
-bool AccelTree::Node::intersectPrim(const Ray& ray, Intersection& isectData) const {
-    if (params.nodeTriangles->size() > 0) {
-        const auto nodeTriangles = params.nodeTriangles;
-        for (auto it = nodeTriangles->begin(); it != nodeTriangles->end(); ++it) {
-            if (it->intersectMT(ray, isectData))
+bool AccelTree::occludedByLeaf(const Node& leaf, const TriangleIntersector& intersector,
+                               Mailbox<MAILBOX_SIZE>& mailbox,
+                               const OpaqueMaterials& opaqueMaterials) const {
+    const int32_t* leafIndices = &leafTriangleIndices[leaf.primsOffset()];
+    const TrianglePacket* packets = &leafPackets[leaf.primsOffset() / TRIANGLE_PACKET_WIDTH];
+    for (int32_t first = 0; first < leaf.numPrims(); first += TRIANGLE_PACKET_WIDTH) {
+        const int32_t activeLanes = testPacketMailbox(leafIndices + first,
+                                                      leaf.numPrims() - first, mailbox);
+        if (!activeLanes)
+            continue;
+
+        const TrianglePacket& packet = packets[first / TRIANGLE_PACKET_WIDTH];
+        PacketHits hits;
+        const int32_t hitLanes = intersectPacket(packet, intersector, activeLanes, hits);
+        for (int32_t lane = 0; lane < TRIANGLE_PACKET_WIDTH; lane++) {
+            if ((hitLanes & (1 << lane)) &&
+                isOpaque(opaqueMaterials, triangles[leafIndices[first + lane]].mesh->materialIdx))
                 return true;
         }
     }
     return false;
 }
 
-AccelTree::AccelTree(const std::vector<Triangle>& triangles, const BBox& sceneBBox) {
+int32_t AccelTree::testPacketMailbox(const int32_t* packetIndices, const int32_t numPrims,
+                                     Mailbox<MAILBOX_SIZE>& mailbox) {
+    int32_t activeLanes = 0;
+    const int32_t numLanes = std::min(numPrims, TRIANGLE_PACKET_WIDTH);
+    for (int32_t lane = 0; lane < numLanes; lane++) {
+        if (!mailbox.testAndSet(packetIndices[lane]))
+            activeLanes |= 1 << lane;
+    }
+    return activeLanes;
+}
+
+/// @brief Strict total order of the triangles' bounds, so the sorted sequence is the same
+/// regardless of the sorting algorithm
+static bool primBoundsLess(const PrimBounds& pb0, const PrimBounds& pb1) {
+    return pb0.bound < pb1.bound || (pb0.bound == pb1.bound && pb0.type < pb1.type);
+}
+
+/// @brief Appends the split events of triangle _primIdx_ with _bounds_ along _axis_ to _events_
+template <typename SplitEvent>
+static void addSplitEvents(std::vector<SplitEvent>& events, const BBox& bounds,
+                           const int32_t axis, const int32_t primIdx) {
+    if (bounds.min[axis] == bounds.max[axis]) {
+        events.push_back({bounds.min[axis], primIdx, SplitEvent::Planar});
+    } else {
+        events.push_back({bounds.min[axis], primIdx, SplitEvent::Start});
+        events.push_back({bounds.max[axis], primIdx, SplitEvent::End});
+    }
+}
+
+/// @brief Clips _triangle_ against the planes of _box_ (Sutherland-Hodgman) and returns the
+/// bounds of the clipped polygon, which are empty if the triangle doesn't overlap the box
+static BBox clipTriangleBounds(const Triangle& triangle, const BBox& box) {
+    // each of the six clip planes adds at most one vertex to the polygon
+    Point3f polygon[9], clipped[9];
+    int32_t numVerts = 3;
+    for (int32_t i = 0; i < 3; i++)
+        polygon[i] = triangle.mesh->vertPositions[triangle.indices[i]];
+
+    for (int32_t axis = 0; axis < 3; axis++) {
+        for (const bool isMinPlane : {true, false}) {
+            const float plane = isMinPlane ? box.min[axis] : box.max[axis];
+            const auto isInside = [&](const Point3f& p) {
+                return isMinPlane ? p[axis] >= plane : p[axis] <= plane;
+            };
+
+            int32_t numClipped = 0;
+            for (int32_t i = 0; i < numVerts; i++) {
+                const Point3f& curr = polygon[i];
+                const Point3f& next = polygon[(i + 1) % numVerts];
+                if (isInside(curr))
+                    clipped[numClipped++] = curr;
+                if (isInside(curr) != isInside(next)) {  // the edge crosses the plane
+                    const float t = (plane - curr[axis]) / (next[axis] - curr[axis]);
+                    clipped[numClipped] = curr + t * (next - curr);
+                    clipped[numClipped++][axis] = plane;
+                }
+            }
+
+            numVerts = numClipped;
+            if (numVerts == 0)
+                return BBox{};
+            std::copy(clipped, clipped + numVerts, polygon);
+        }
+    }
+
+    // the clipped vertices may be off by rounding errors, keep the bounds inside the box
+    BBox bounds;
+    for (int32_t i = 0; i < numVerts; i++)
+        bounds.expandBy(polygon[i]);
+    bounds.min = maxPoint(bounds.min, box.min);
+    bounds.max = minPoint(bounds.max, box.max);
+    return bounds;
+}
+
+/// @brief Verifies if _box_ bounds nothing
+static bool isEmpty(const BBox& box) {
+    return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+}
+
+AccelTree::AccelTree(std::vector<Triangle> sceneTriangles, const BBox& sceneBBox,
+                     const AccelTreeSettings& treeSettings, ThreadPool* pool)
+    : triangles(std::move(sceneTriangles)), bounds(sceneBBox), settings(treeSettings) {
     Timer timer;
-    std::cout << "Start building acceleration tree...\n";
     timer.start();
+    uint64_t cacheKey = 0;
+    if (!settings.cacheFile.empty()) {
+        cacheKey = computeCacheKey();
+        if (loadCache(cacheKey)) {
+            packLeaves();
+            std::cout << "Acceleration tree with " << nodes.size() << " nodes loaded from "
+                      << settings.cacheFile << " for [" << std::fixed << std::setprecision(2)
+                      << Timer::toMilliSec<float>(timer.getElapsedNanoSec()) << "ms]\n";
+            return;
+        }
+    }
+
+    std::cout << "Start building acceleration tree...\n";
     // compute AABB for each triangle in the scene
     std::vector<BBox> trianglesBBoxes;
     trianglesBBoxes.reserve(triangles.size());
+    BuildNode root{0, 0, sceneBBox, std::vector<int32_t>(triangles.size()), {}};
     for (size_t i = 0; i < triangles.size(); i++) {
         trianglesBBoxes.emplace_back(getTriangleBBox(triangles[i]));
+        root.triangleIndices[i] = (int32_t)i;
+    }
+    if (settings.splitMethod == SplitMethod::EventSAH)
+        initSplitEvents(root, trianglesBBoxes, pool);
+
+    if (pool && triangles.size() >= PARALLEL_BUILD_MIN_TRIANGLES) {
+        // split the top levels on the calling thread, build the subtrees below them on the
+        // workers, then splice everything in the same depth-first order as the serial build
+        std::vector<Node> skeleton;
+        std::vector<Subtree> subtrees;
+        buildTopLevels(root, trianglesBBoxes, skeleton, subtrees, *pool);
+        pool->parallelFor(subtrees.size(), [&](const size_t i) {
+            Subtree& subtree = subtrees[i];
+            if (subtree.storage.nodes.empty())
+                buildAccelTree(subtree.node, trianglesBBoxes, subtree.storage);
+        });
+        spliceSubtrees(0, skeleton, subtrees);
+    } else {  // recursively build the tree
+        BuildStorage storage;
+        buildAccelTree(root, trianglesBBoxes, storage);
+        nodes = std::move(storage.nodes);
+        leafTriangleIndices = std::move(storage.leafTriangleIndices);
     }
-    const int32_t rootIdx = addNode(Node{-1, -1, Interior, NodeParams{}});
-    // recursively build the tree
-    buildAccelTree(rootIdx, 0, triangles, trianglesBBoxes, sceneBBox);
-    std::cout << "Acceleration tree with " << nodes.size() << " nodes build for [" << std::fixed
-              << std::setprecision(2) << Timer::toMilliSec<float>(timer.getElapsedNanoSec())
-              << "ms]\n";
+
+    const size_t treeBytes =
+        nodes.size() * sizeof(Node) + leafTriangleIndices.size() * sizeof(int32_t);
+    std::cout << "Acceleration tree with " << nodes.size() << " nodes [" << treeBytes / 1024
+              << "KB] build for [" << std::fixed << std::setprecision(2)
+              << Timer::toMilliSec<float>(timer.getElapsedNanoSec()) << "ms]\n";
+
+    // the cache keeps the compact leaves, the packets are created from them on load
+    if (!settings.cacheFile.empty())
+        saveCache(cacheKey);
+    packLeaves();
 }
 
-void AccelTree::buildAccelTree(const int32_t parentIdx, const int32_t treeDepth,
-                               const std::vector<Triangle>& triangles,
-                               const std::vector<BBox>& trianglesBBoxes, const BBox& nodeBBox) {
-    // if conditions met initialize leaf node
-    if (treeDepth >= MAX_TREE_DEPTH || triangles.size() <= MAX_TRIANGLES_PER_NODE) {
-        nodes[parentIdx].params.nodeTriangles = new std::vector<Triangle>(triangles.size());
-        *nodes[parentIdx].params.nodeTriangles = triangles;
-        nodes[parentIdx].type = Leaf;
+void AccelTree::packLeaves() {
+    // each leaf starts at a packet boundary, the unused lanes of its last packet are degenerate
+    // triangles referenced by index -1
+    std::vector<int32_t> packedIndices;
+    packedIndices.reserve(leafTriangleIndices.size() * 2);
+    leafPackets.clear();
+    for (Node& node : nodes) {
+        if (!node.isLeaf())
+            continue;
+
+        const int32_t numPrims = node.numPrims();
+        const int32_t packedOffset = (int32_t)packedIndices.size();
+        packedIndices.insert(packedIndices.end(),
+                             leafTriangleIndices.begin() + node.primsOffset(),
+                             leafTriangleIndices.begin() + node.primsOffset() + numPrims);
+        const size_t numPackets =
+            (packedIndices.size() + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH;
+        packedIndices.resize(numPackets * TRIANGLE_PACKET_WIDTH, -1);
+        node.initLeaf(packedOffset, numPrims);
+    }
+    leafTriangleIndices = std::move(packedIndices);
+    leafPackets.resize(leafTriangleIndices.size() / TRIANGLE_PACKET_WIDTH);
+    updateLeafPackets();
+
+    std::cout << "Leaf triangles packed in " << leafPackets.size() << " packets ["
+              << leafPackets.size() * sizeof(TrianglePacket) / 1024 << "KB] for the "
+              << getPacketKernelName() << " kernel\n";
+}
+
+void AccelTree::updateLeafPackets() {
+    for (size_t i = 0; i < leafTriangleIndices.size(); i++) {
+        const int32_t triangleIdx = leafTriangleIndices[i];
+        const TriangleRecord record = triangleIdx >= 0
+                                          ? TriangleRecord(triangles[triangleIdx], isectMethod)
+                                          : TriangleRecord();
+        leafPackets[i / TRIANGLE_PACKET_WIDTH].setLane(i % TRIANGLE_PACKET_WIDTH, record);
+    }
+}
+
+void AccelTree::setTriangleIntersection(const TriangleIntersection method) {
+    if (method == isectMethod)
         return;
+
+    Accelerator::setTriangleIntersection(method);
+    updateLeafPackets();
+}
+
+uint64_t AccelTree::computeCacheKey() const {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    const auto hashValue = [&hash](const auto& value) {
+        hash = hashBytes(&value, sizeof(value), hash);
+    };
+
+    // all settings that affect the built tree, the cache file itself does not
+    hashValue(ACCEL_TREE_CACHE_VERSION);
+    hashValue((int32_t)settings.splitMethod);
+    hashValue(settings.traversalCost);
+    hashValue(settings.isectCost);
+    hashValue(settings.emptyBonus);
+    hashValue(settings.maxLeafTriangles);
+    hashValue(settings.maxDepth);
+    hashValue(settings.maxBadRefines);
+    hashValue((int32_t)settings.perfectSplits);
+    for (int32_t axis = 0; axis < 3; axis++) {
+        hashValue(bounds.min[axis]);
+        hashValue(bounds.max[axis]);
+    }
+
+    // the vertex indices and positions of the triangles in the order the tree references them
+    struct TriangleData {
+        int32_t indices[3];
+        float positions[9];
+    };
+    for (const Triangle& triangle : triangles) {
+        TriangleData triangleData;
+        for (int32_t i = 0; i < 3; i++) {
+            const Point3f& vertex = triangle.mesh->vertPositions[triangle.indices[i]];
+            triangleData.indices[i] = triangle.indices[i];
+            triangleData.positions[3 * i] = vertex.x;
+            triangleData.positions[3 * i + 1] = vertex.y;
+            triangleData.positions[3 * i + 2] = vertex.z;
+        }
+        hash = hashBytes(&triangleData, sizeof(triangleData), hash);
+    }
+
+    return hash;
+}
+
+bool AccelTree::loadCache(const uint64_t cacheKey) {
+    const MappedFile cacheFile(settings.cacheFile);
+    if (!cacheFile.isValid() || cacheFile.size() < sizeof(AccelTreeCacheHeader))
+        return false;
+
+    AccelTreeCacheHeader header;
+    std::memcpy(&header, cacheFile.data(), sizeof(header));
+    if (std::memcmp(header.magic, ACCEL_TREE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != ACCEL_TREE_CACHE_VERSION || header.nodeSize != sizeof(Node) ||
+        header.key != cacheKey || header.numTriangles != triangles.size() ||
+        header.numNodes == 0)
+        return false;
+
+    const size_t nodesBytes = header.numNodes * sizeof(Node);
+    const size_t indicesBytes = header.numLeafIndices * sizeof(int32_t);
+    if (cacheFile.size() != sizeof(header) + nodesBytes + indicesBytes)
+        return false;
+
+    nodes.resize(header.numNodes);
+    leafTriangleIndices.resize(header.numLeafIndices);
+    std::memcpy(nodes.data(), cacheFile.data() + sizeof(header), nodesBytes);
+    std::memcpy(leafTriangleIndices.data(), cacheFile.data() + sizeof(header) + nodesBytes,
+                indicesBytes);
+
+    // reject damaged files instead of traversing out of bounds. The children follow their parent,
+    // so checking that every node is reached exactly once from the nodes before it proves the
+    // nodes form a tree, whose depth must fit the traversal stack
+    std::vector<int32_t> depths(nodes.size(), -1);
+    depths[0] = 0;
+    const auto setChildDepth = [&](const size_t childIdx, const int32_t depth) {
+        if (childIdx >= nodes.size() || depths[childIdx] >= 0)
+            return false;
+        depths[childIdx] = depth;
+        return true;
+    };
+    bool validNodes = true;
+    for (size_t i = 0; i < nodes.size() && validNodes; i++) {
+        const Node& node = nodes[i];
+        if (depths[i] < 0) {  // not referenced by any node before it
+            validNodes = false;
+        } else if (node.isLeaf()) {
+            validNodes = node.primsOffset() >= 0 && node.numPrims() >= 0 &&
+                         (size_t)node.primsOffset() + node.numPrims() <= leafTriangleIndices.size();
+        } else {
+            const size_t aboveChildIdx = (size_t)node.aboveChildIdx();
+            validNodes = depths[i] < MAX_TREE_DEPTH && node.aboveChildIdx() > 0 &&
+                         aboveChildIdx > i + 1 && setChildDepth(i + 1, depths[i] + 1) &&
+                         setChildDepth(aboveChildIdx, depths[i] + 1);
+        }
+    }
+    const bool validIndices =
+        std::all_of(leafTriangleIndices.begin(), leafTriangleIndices.end(),
+                    [&](const int32_t idx) { return idx >= 0 && (size_t)idx < triangles.size(); });
+    if (!validNodes || !validIndices) {
+        nodes.clear();
+        leafTriangleIndices.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void AccelTree::saveCache(const uint64_t cacheKey) const {
+    AccelTreeCacheHeader header;
+    std::memcpy(header.magic, ACCEL_TREE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = ACCEL_TREE_CACHE_VERSION;
+    header.nodeSize = sizeof(Node);
+    header.key = cacheKey;
+    header.numTriangles = triangles.size();
+    header.numNodes = nodes.size();
+    header.numLeafIndices = leafTriangleIndices.size();
+
+    // write to temporary file first, so that a reader never maps a partially written cache
+    const std::string tempFile = settings.cacheFile + ".tmp";
+    {
+        std::ofstream cacheStream(tempFile, std::ios::binary | std::ios::trunc);
+        cacheStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        cacheStream.write(reinterpret_cast<const char*>(nodes.data()),
+                          nodes.size() * sizeof(Node));
+        cacheStream.write(reinterpret_cast<const char*>(leafTriangleIndices.data()),
+                          leafTriangleIndices.size() * sizeof(int32_t));
+        if (!cacheStream.good()) {
+            std::cerr << "Failed to write acceleration tree cache " << tempFile << std::endl;
+            return;
+        }
     }
 
+    std::error_code errorCode;
+    std::filesystem::rename(tempFile, settings.cacheFile, errorCode);
+    if (errorCode)
+        std::cerr << "Failed to write acceleration tree cache " << settings.cacheFile << std::endl;
+}
+
+void AccelTree::initSplitEvents(BuildNode& root, const std::vector<BBox>& trianglesBBoxes,
+                                ThreadPool* pool) {
+    for (int32_t axis = 0; axis < 3; axis++) {
+        std::vector<SplitEvent>& axisEvents = root.events[axis];
+        axisEvents.reserve(root.triangleIndices.size() * 2);
+        for (int32_t i = 0; i < (int32_t)root.triangleIndices.size(); i++)
+            addSplitEvents(axisEvents, trianglesBBoxes[root.triangleIndices[i]], axis, i);
+
+        // the only sort of the build, the children inherit sorted events from their parent
+        if (pool)
+            pool->parallelSort(axisEvents.begin(), axisEvents.end(), std::less<SplitEvent>());
+        else
+            std::sort(axisEvents.begin(), axisEvents.end());
+    }
+}
+
+float AccelTree::computeSplitCost(const BBox& nodeBBox, const float invNodeSurfArea,
+                                  const int32_t axis, const float splitPos,
+                                  const int32_t numBelow, const int32_t numAbove) const {
+    // probability of a ray that hits the node to hit each of the children
+    const Vector3f nodeDiagonal = nodeBBox.max - nodeBBox.min;
+    const int32_t otherAxis0 = (axis + 1) % 3, otherAxis1 = (axis + 2) % 3;
+    const float belowSA = 2 * (nodeDiagonal[otherAxis0] * nodeDiagonal[otherAxis1] +
+                               (splitPos - nodeBBox.min[axis]) *
+                                   (nodeDiagonal[otherAxis0] + nodeDiagonal[otherAxis1]));
+    const float aboveSA = 2 * (nodeDiagonal[otherAxis0] * nodeDiagonal[otherAxis1] +
+                               (nodeBBox.max[axis] - splitPos) *
+                                   (nodeDiagonal[otherAxis0] + nodeDiagonal[otherAxis1]));
+    const float probBelow = belowSA * invNodeSurfArea;
+    const float probAbove = aboveSA * invNodeSurfArea;
+
+    // favor splits that cut off empty space
+    const float emptyBonus = (numBelow == 0 || numAbove == 0) ? settings.emptyBonus : 0.f;
+    return settings.traversalCost +
+           settings.isectCost * (1.f - emptyBonus) * (probBelow * numBelow + probAbove * numAbove);
+}
+
+bool AccelTree::findSplit(const BuildNode& node, const std::vector<BBox>& trianglesBBoxes,
+                          ThreadPool* pool, SplitPlane& split) const {
+    // if conditions met the node should be leaf
+    if (node.depth >= std::min(settings.maxDepth, MAX_TREE_DEPTH) ||
+        (int32_t)node.triangleIndices.size() <= settings.maxLeafTriangles)
+        return false;
+
     // find axis and position for splitting of interior node
-    int8_t axis = -1;
-    float splitPos = Infinity;
-    switch (splitMethod) {
+    const BBox& nodeBBox = node.bbox;
+    const int32_t numPrims = (int32_t)node.triangleIndices.size();
+    switch (settings.splitMethod) {
         case SplitMethod::Middle: {  // split axis in middle
-            axis = (int8_t)(treeDepth % 3);
-            splitPos = (nodeBBox.min[axis] + nodeBBox.max[axis]) * 0.5f;
-            nodes[parentIdx].splitAxis = axis;
-            nodes[parentIdx].splitPos = splitPos;
-            break;
+            split.axis = node.depth % 3;
+            split.pos = (nodeBBox.min[split.axis] + nodeBBox.max[split.axis]) * 0.5f;
+            split.badRefines = node.badRefines;
+            return true;
         }
-        case SplitMethod::SAH: {                      // the SAH approach used in pbrt
-            axis = (uint8_t)findMaxExtent(nodeBBox);  // choose the longest axis for split
-            const float isectCost = 60.0f;
-
-            // populate the minimum and maximum extent of each triangle for the choosen axis
+        case SplitMethod::SAH: {  // the SAH approach used in pbrt
+            const float invNodeSurfArea = 1.f / surfaceArea(nodeBBox);
+            float bestSplitCost = Infinity;
             std::vector<PrimBounds> trianglesBounds;
-            trianglesBounds.reserve(trianglesBBoxes.size() * 2);
-            for (size_t i = 0; i < trianglesBBoxes.size(); ++i) {
-                trianglesBounds.push_back(
-                    PrimBounds{trianglesBBoxes[i].min[axis], PrimBounds::Min});
-                trianglesBounds.push_back(
-                    PrimBounds{trianglesBBoxes[i].max[axis], PrimBounds::Max});
-            }
+            trianglesBounds.reserve(node.triangleIndices.size() * 2);
+            for (int32_t axis = 0; axis < 3; axis++) {
+                // populate the minimum and maximum extent of each triangle for the current axis
+                trianglesBounds.clear();
+                for (const int32_t triangleIdx : node.triangleIndices) {
+                    trianglesBounds.push_back(
+                        PrimBounds{trianglesBBoxes[triangleIdx].min[axis], PrimBounds::Min});
+                    trianglesBounds.push_back(
+                        PrimBounds{trianglesBBoxes[triangleIdx].max[axis], PrimBounds::Max});
+                }
 
-            // sort the bounds
-            std::sort(
-                trianglesBounds.begin(), trianglesBounds.end(),
-                [](const PrimBounds& pb0, const PrimBounds& pb1) { return pb0.bound < pb1.bound; });
-
-            const Vector3f nodeDiagonal = nodeBBox.max - nodeBBox.min;
-            const float nodeSurfArea =
-                2 * (nodeDiagonal.x * nodeDiagonal.y + nodeDiagonal.x * nodeDiagonal.z +
-                     nodeDiagonal.y * nodeDiagonal.z);
-            const float invNodeSurfArea = 1.f / nodeSurfArea;
-            float bestSplitCost = 1e30;
-            int32_t bestOffset = -1;
-            const float oldCost = isectCost * triangles.size();
-
-            // compute the cost of all possible splits for the chosen axis to find the best
-            int32_t lowerBoundPrims = 0, upperBoundPrims = (int32_t)triangles.size();
-            for (size_t i = 0; i < triangles.size() * 2; ++i) {
-                if (trianglesBounds[i].type == PrimBounds::Max)
-                    --upperBoundPrims;
-                const float currBound = trianglesBounds[i].bound;
-                if (currBound > nodeBBox.min[axis] && currBound < nodeBBox.max[axis]) {
-                    int otherAxis0 = (axis + 1) % 3, otherAxis1 = (axis + 2) % 3;
-                    float lowerBoundSA =
-                        2 * (nodeDiagonal[otherAxis0] * nodeDiagonal[otherAxis1] +
-                             (currBound - nodeBBox.min[axis]) *
-                                 (nodeDiagonal[otherAxis0] + nodeDiagonal[otherAxis1]));
-                    float upperBoundSA =
-                        2 * (nodeDiagonal[otherAxis0] * nodeDiagonal[otherAxis1] +
-                             (nodeBBox.max[axis] - currBound) *
-                                 (nodeDiagonal[otherAxis0] + nodeDiagonal[otherAxis1]));
-                    float probLowerBound = lowerBoundSA * invNodeSurfArea;
-                    float probUpperBound = upperBoundSA * invNodeSurfArea;
-                    float splitCost = isectCost * (probLowerBound * lowerBoundPrims +
-                                                   probUpperBound * upperBoundPrims);
-                    if (splitCost < bestSplitCost) {
-                        bestSplitCost = splitCost;
-                        bestOffset = (int32_t)i;
+                // sort the bounds, in parallel for the large nodes at the top of the tree
+                if (pool && node.triangleIndices.size() >= PARALLEL_BUILD_MIN_TRIANGLES)
+                    pool->parallelSort(trianglesBounds.begin(), trianglesBounds.end(),
+                                       primBoundsLess);
+                else
+                    std::sort(trianglesBounds.begin(), trianglesBounds.end(), primBoundsLess);
+
+                // compute the cost of all possible splits for the current axis to find the best
+                int32_t lowerBoundPrims = 0, upperBoundPrims = numPrims;
+                for (size_t i = 0; i < trianglesBounds.size(); ++i) {
+                    if (trianglesBounds[i].type == PrimBounds::Max)
+                        --upperBoundPrims;
+                    const float currBound = trianglesBounds[i].bound;
+                    if (currBound > nodeBBox.min[axis] && currBound < nodeBBox.max[axis]) {
+                        const float splitCost =
+                            computeSplitCost(nodeBBox, invNodeSurfArea, axis, currBound,
+                                             lowerBoundPrims, upperBoundPrims);
+                        if (splitCost < bestSplitCost) {
+                            bestSplitCost = splitCost;
+                            split.axis = axis;
+                            split.pos = currBound;
+                        }
                     }
+                    if (trianglesBounds[i].type == PrimBounds::Min)
+                        ++lowerBoundPrims;
                 }
-                if (trianglesBounds[i].type == PrimBounds::Min)
-                    ++lowerBoundPrims;
-            }
-            Assert(lowerBoundPrims == (int32_t)triangles.size() && upperBoundPrims == 0);
-
-            // initialize leaf node if no good split were found
-            if (bestSplitCost > 4 * oldCost) {
-                nodes[parentIdx].params.nodeTriangles = new std::vector<Triangle>(triangles.size());
-                *nodes[parentIdx].params.nodeTriangles = triangles;
-                nodes[parentIdx].type = Leaf;
-                return;
+                Assert(lowerBoundPrims == numPrims && upperBoundPrims == 0);
             }
 
-            // set the found axis and split position for the current interior node
-            splitPos = trianglesBounds[bestOffset].bound;
-            nodes[parentIdx].splitAxis = axis;
-            nodes[parentIdx].splitPos = splitPos;
-            break;
+            return acceptSplit(node, bestSplitCost, split);
         }
+        case SplitMethod::EventSAH:
+            return findEventSplit(node, split);
         default:
             Assert(false && "Received unsupported split method.");
     }
 
-    // split the current node
-    const auto [leftChildBox, rightChildBox] = splitBBox(nodeBBox, axis, splitPos);
+    return false;
+}
+
+bool AccelTree::findEventSplit(const BuildNode& node, SplitPlane& split) const {
+    const BBox& nodeBBox = node.bbox;
+    const float invNodeSurfArea = 1.f / surfaceArea(nodeBBox);
+    const int32_t numPrims = (int32_t)node.triangleIndices.size();
+    float bestSplitCost = Infinity;
+
+    // sweep the sorted events of each axis and evaluate the cost of a split at each position
+    for (int32_t axis = 0; axis < 3; axis++) {
+        const std::vector<SplitEvent>& axisEvents = node.events[axis];
+        int32_t numBelow = 0, numPlanar = 0, numAbove = numPrims;
+        for (size_t i = 0; i < axisEvents.size();) {
+            const float pos = axisEvents[i].pos;
+            int32_t numEnding = 0, numInPlane = 0, numStarting = 0;
+            for (; i < axisEvents.size() && axisEvents[i].pos == pos &&
+                   axisEvents[i].type == SplitEvent::End;
+                 ++i)
+                ++numEnding;
+            for (; i < axisEvents.size() && axisEvents[i].pos == pos &&
+                   axisEvents[i].type == SplitEvent::Planar;
+                 ++i)
+                ++numInPlane;
+            for (; i < axisEvents.size() && axisEvents[i].pos == pos &&
+                   axisEvents[i].type == SplitEvent::Start;
+                 ++i)
+                ++numStarting;
+
+            numPlanar = numInPlane;
+            numAbove -= numInPlane + numEnding;
+            if (pos > nodeBBox.min[axis] && pos < nodeBBox.max[axis]) {
+                // triangles lying in the split plane go to the cheaper side
+                const float costPlanarBelow = computeSplitCost(
+                    nodeBBox, invNodeSurfArea, axis, pos, numBelow + numPlanar, numAbove);
+                const float costPlanarAbove =
+                    numPlanar == 0 ? costPlanarBelow
+                                   : computeSplitCost(nodeBBox, invNodeSurfArea, axis, pos,
+                                                      numBelow, numAbove + numPlanar);
+                const bool planarBelow = costPlanarBelow <= costPlanarAbove;
+                const float splitCost = planarBelow ? costPlanarBelow : costPlanarAbove;
+                if (splitCost < bestSplitCost) {
+                    bestSplitCost = splitCost;
+                    split.axis = axis;
+                    split.pos = pos;
+                    split.planarBelow = planarBelow;
+                }
+            }
+            numBelow += numStarting + numInPlane;
+        }
+        Assert(numBelow == numPrims && numAbove == 0);
+    }
+
+    return acceptSplit(node, bestSplitCost, split);
+}
 
-    // allocate storage for the triangles and AABB of both children nodes
-    std::vector<Triangle> leftChildTriangles, rightChildTriangles;
-    std::vector<BBox> leftChildBBoxes, rightChildBBoxes;
+bool AccelTree::acceptSplit(const BuildNode& node, const float bestSplitCost,
+                            SplitPlane& split) const {
+    // no split plane inside the node bounds
+    if (split.axis == -1)
+        return false;
+
+    // tolerate a few splits that are more expensive than a leaf as they may enable good splits
+    // further down, after that the node should be leaf
+    const float leafCost = settings.isectCost * node.triangleIndices.size();
+    split.badRefines = node.badRefines + (bestSplitCost > leafCost ? 1 : 0);
+    return split.badRefines <= settings.maxBadRefines;
+}
 
-    leftChildTriangles.reserve(triangles.size());
-    leftChildBBoxes.reserve(triangles.size());
-    rightChildTriangles.reserve(triangles.size());
-    rightChildBBoxes.reserve(triangles.size());
+void AccelTree::splitNode(BuildNode& node, const SplitPlane& split,
+                          const std::vector<BBox>& trianglesBBoxes, BuildNode& below,
+                          BuildNode& above) const {
+    const auto [belowBox, aboveBox] = splitBBox(node.bbox, split.axis, split.pos);
+    below = BuildNode{node.depth + 1, split.badRefines, belowBox, {}, {}};
+    above = BuildNode{node.depth + 1, split.badRefines, aboveBox, {}, {}};
+    below.triangleIndices.reserve(node.triangleIndices.size());
+    above.triangleIndices.reserve(node.triangleIndices.size());
+
+    if (settings.splitMethod != SplitMethod::EventSAH) {
+        // distribute the triangles to the children boxes they overlap with
+        for (const int32_t triangleIdx : node.triangleIndices) {
+            const BBox& triangleBBox = trianglesBBoxes[triangleIdx];
+            if (boxIntersect(belowBox, triangleBBox))
+                below.triangleIndices.push_back(triangleIdx);
+            if (boxIntersect(aboveBox, triangleBBox))
+                above.triangleIndices.push_back(triangleIdx);
+        }
+        return;
+    }
 
-    // populate the triangles and AABB for the left and right child nodes
-    for (size_t i = 0; i < triangles.size(); ++i) {
-        const BBox triangleBBox = trianglesBBoxes[i];
-        if (boxIntersect(leftChildBox, triangleBBox)) {
-            leftChildTriangles.push_back(triangles[i]);
-            leftChildBBoxes.push_back(triangleBBox);
+    // classify the triangles by the events along the split axis, the rest straddle the plane
+    enum Side : int8_t { Below, Above, Both };
+    const int32_t numPrims = (int32_t)node.triangleIndices.size();
+    std::vector<Side> sides(numPrims, Both);
+    for (const SplitEvent& event : node.events[split.axis]) {
+        if (event.type == SplitEvent::End && event.pos <= split.pos)
+            sides[event.primIdx] = Below;
+        else if (event.type == SplitEvent::Start && event.pos >= split.pos)
+            sides[event.primIdx] = Above;
+        else if (event.type == SplitEvent::Planar) {
+            if (event.pos == split.pos)
+                sides[event.primIdx] = split.planarBelow ? Below : Above;
+            else
+                sides[event.primIdx] = event.pos < split.pos ? Below : Above;
         }
-        if (boxIntersect(rightChildBox, triangleBBox)) {
-            rightChildTriangles.push_back(triangles[i]);
-            rightChildBBoxes.push_back(triangleBBox);
+    }
+
+    // clip the straddling triangles to the children boxes, a triangle whose bounding box
+    // straddles the plane may still lie entirely on one side of it
+    struct ClippedTriangle {
+        int32_t primIdx;
+        BBox belowBounds;
+        BBox aboveBounds;
+    };
+    std::vector<ClippedTriangle> clippedTriangles;
+    if (settings.perfectSplits) {
+        for (int32_t i = 0; i < numPrims; i++) {
+            if (sides[i] != Both)
+                continue;
+            const Triangle& triangle = triangles[node.triangleIndices[i]];
+            const BBox belowBounds = clipTriangleBounds(triangle, belowBox);
+            const BBox aboveBounds = clipTriangleBounds(triangle, aboveBox);
+            const bool overlapsBelow = !isEmpty(belowBounds);
+            const bool overlapsAbove = !isEmpty(aboveBounds);
+            if (overlapsBelow && overlapsAbove)
+                clippedTriangles.push_back({i, belowBounds, aboveBounds});
+            else if (overlapsBelow || overlapsAbove)
+                sides[i] = overlapsBelow ? Below : Above;
+            // a triangle lost by both clips due to rounding keeps its unclipped events
         }
     }
 
-    // recursively initialize left and right child nodes
-    if (leftChildTriangles.size() > 0) {
-        const int32_t leftChildIdx = addNode(Node{parentIdx, -1, Interior, NodeParams{}});
-        nodes[parentIdx].params.children[0] = leftChildIdx;
-        buildAccelTree(leftChildIdx, treeDepth + 1, leftChildTriangles, leftChildBBoxes,
-                       leftChildBox);
+    // assign the triangles to the children and remap their indices to the children's lists
+    std::vector<int32_t> belowIndices(numPrims, -1), aboveIndices(numPrims, -1);
+    for (int32_t i = 0; i < numPrims; i++) {
+        if (sides[i] != Above) {
+            belowIndices[i] = (int32_t)below.triangleIndices.size();
+            below.triangleIndices.push_back(node.triangleIndices[i]);
+        }
+        if (sides[i] != Below) {
+            aboveIndices[i] = (int32_t)above.triangleIndices.size();
+            above.triangleIndices.push_back(node.triangleIndices[i]);
+        }
     }
-    if (rightChildTriangles.size() > 0) {
-        const int32_t rightChildIdx = addNode(Node{parentIdx, -1, Interior, NodeParams{}});
-        nodes[parentIdx].params.children[1] = rightChildIdx;
-        buildAccelTree(rightChildIdx, treeDepth + 1, rightChildTriangles, rightChildBBoxes,
-                       rightChildBox);
+
+    // the clipped triangles get new events from their clipped bounds
+    std::vector<bool> isClipped(numPrims, false);
+    for (const ClippedTriangle& clippedTriangle : clippedTriangles)
+        isClipped[clippedTriangle.primIdx] = true;
+
+    // split the event lists in linear time, the relative order and so the sorting is preserved
+    for (int32_t axis = 0; axis < 3; axis++) {
+        below.events[axis].reserve(below.triangleIndices.size() * 2);
+        above.events[axis].reserve(above.triangleIndices.size() * 2);
+        for (const SplitEvent& event : node.events[axis]) {
+            if (isClipped[event.primIdx])
+                continue;
+            if (sides[event.primIdx] != Above)
+                below.events[axis].push_back({event.pos, belowIndices[event.primIdx], event.type});
+            if (sides[event.primIdx] != Below)
+                above.events[axis].push_back({event.pos, aboveIndices[event.primIdx], event.type});
+        }
+        node.events[axis] = std::vector<SplitEvent>{};
+
+        if (clippedTriangles.empty())
+            continue;
+
+        // only the few new events are sorted before merging them into the sorted lists
+        std::vector<SplitEvent> belowClipped, aboveClipped;
+        for (const ClippedTriangle& clippedTriangle : clippedTriangles) {
+            addSplitEvents(belowClipped, clippedTriangle.belowBounds, axis,
+                           belowIndices[clippedTriangle.primIdx]);
+            addSplitEvents(aboveClipped, clippedTriangle.aboveBounds, axis,
+                           aboveIndices[clippedTriangle.primIdx]);
+        }
+        for (auto [childEvents, clippedEvents] :
+             {std::pair{&below.events[axis], &belowClipped},
+              std::pair{&above.events[axis], &aboveClipped}}) {
+            std::sort(clippedEvents->begin(), clippedEvents->end());
+            const size_t numSorted = childEvents->size();
+            childEvents->insert(childEvents->end(), clippedEvents->begin(), clippedEvents->end());
+            std::inplace_merge(childEvents->begin(), childEvents->begin() + numSorted,
+                               childEvents->end());
+        }
     }
 }
 
-int32_t AccelTree::addNode(const Node& node) {
-    const int32_t currTreeSize = (int32_t)nodes.size();
-    nodes.push_back(node);
-    return currTreeSize;
+void AccelTree::buildAccelTree(BuildNode& node, const std::vector<BBox>& trianglesBBoxes,
+                               BuildStorage& storage) const {
+    const int32_t nodeIdx = (int32_t)storage.nodes.size();
+    storage.nodes.emplace_back();
+
+    SplitPlane split;
+    if (!findSplit(node, trianglesBBoxes, nullptr, split)) {
+        addLeaf(storage, nodeIdx, node.triangleIndices);
+        return;
+    }
+
+    // split the current node and populate the triangles for the children nodes
+    BuildNode below, above;
+    splitNode(node, split, trianglesBBoxes, below, above);
+    node = BuildNode{};
+
+    // recursively initialize left and right child nodes, the left (below) child directly
+    // follows its parent, so only the index of the right (above) child is kept
+    buildAccelTree(below, trianglesBBoxes, storage);
+    const int32_t rightChildIdx = (int32_t)storage.nodes.size();
+    buildAccelTree(above, trianglesBBoxes, storage);
+    storage.nodes[nodeIdx].initInterior(split.axis, rightChildIdx, split.pos);
 }
 
-void AccelTree::clearTree() {
-    std::for_each(nodes.begin(), nodes.end(), [](Node& node) {
-        if (node.type == Leaf) {
-            node.params.nodeTriangles->clear();
-            delete node.params.nodeTriangles;
-        }
-    });
+void AccelTree::buildTopLevels(BuildNode& node, const std::vector<BBox>& trianglesBBoxes,
+                               std::vector<Node>& skeleton, std::vector<Subtree>& subtrees,
+                               ThreadPool& pool) const {
+    const int32_t nodeIdx = (int32_t)skeleton.size();
+    skeleton.emplace_back();
+
+    // small nodes become subtrees that are built later on the workers
+    if (node.triangleIndices.size() < PARALLEL_BUILD_MIN_TRIANGLES) {
+        skeleton[nodeIdx].initLeaf((int32_t)subtrees.size(), 0);
+        subtrees.push_back(Subtree{std::move(node), BuildStorage{}});
+        return;
+    }
+
+    SplitPlane split;
+    if (!findSplit(node, trianglesBBoxes, &pool, split)) {  // large leaves are initialized now
+        skeleton[nodeIdx].initLeaf((int32_t)subtrees.size(), 0);
+        subtrees.push_back(Subtree{BuildNode{}, BuildStorage{}});
+        subtrees.back().storage.nodes.emplace_back();
+        addLeaf(subtrees.back().storage, 0, node.triangleIndices);
+        return;
+    }
+
+    BuildNode below, above;
+    splitNode(node, split, trianglesBBoxes, below, above);
+    node = BuildNode{};
+
+    buildTopLevels(below, trianglesBBoxes, skeleton, subtrees, pool);
+    const int32_t rightChildIdx = (int32_t)skeleton.size();
+    buildTopLevels(above, trianglesBBoxes, skeleton, subtrees, pool);
+    skeleton[nodeIdx].initInterior(split.axis, rightChildIdx, split.pos);
 }
 
-bool AccelTree::intersect(const Ray& ray, const BBox& sceneBBox, Intersection& isectData) const {
-    std::stack<NodeIndexBBoxPair> nodesStack;
-    nodesStack.push({0, sceneBBox});
-    bool hasIntersect = false;
-    Intersection closestPrim;
-    while (!nodesStack.empty()) {
-        const auto [currNodeIdx, currNodeBBox] = std::move(nodesStack.top());
-        nodesStack.pop();
-        const Node& currNode = nodes[currNodeIdx];
-        if (currNodeBBox.intersect(ray)) {
-            if (currNode.type == Interior) {  // stack interior nodes for traversal
-                const auto [leftChildBox, rightChildBox] =
-                    splitBBox(currNodeBBox, currNode.splitAxis, currNode.splitPos);
-                if (currNode.params.children[0] != -1)
-                    nodesStack.push({currNode.params.children[0], leftChildBox});
-                if (currNode.params.children[1] != -1)
-                    nodesStack.push({currNode.params.children[1], rightChildBox});
-            } else {  // search for the closest intersection with the leaf's triangles
-                bool currNodeIntersect = currNode.intersect(ray, isectData);
-                if (currNodeIntersect) {
-                    if (isectData.t < closestPrim.t)
-                        closestPrim = isectData;
-                    hasIntersect = true;
-                }
-            }
+void AccelTree::spliceSubtrees(const int32_t skeletonIdx, const std::vector<Node>& skeleton,
+                               std::vector<Subtree>& subtrees) {
+    const Node& skeletonNode = skeleton[skeletonIdx];
+    if (skeletonNode.isLeaf()) {  // the leaves of the skeleton reference the built subtrees
+        BuildStorage& storage = subtrees[skeletonNode.primsOffset()].storage;
+        const int32_t nodesOffset = (int32_t)nodes.size();
+        const int32_t primsOffset = (int32_t)leafTriangleIndices.size();
+        for (Node node : storage.nodes) {
+            if (node.isLeaf())
+                node.leafPrimsOffset += primsOffset;
+            else
+                node.aboveChild += (nodesOffset << 2);
+            nodes.push_back(node);
         }
+        leafTriangleIndices.insert(leafTriangleIndices.end(), storage.leafTriangleIndices.begin(),
+                                   storage.leafTriangleIndices.end());
+        storage = BuildStorage{};
+        return;
     }
 
-    if (hasIntersect)
-        isectData = closestPrim;
+    const int32_t nodeIdx = (int32_t)nodes.size();
+    nodes.emplace_back();
+    spliceSubtrees(skeletonIdx + 1, skeleton, subtrees);
+    const int32_t rightChildIdx = (int32_t)nodes.size();
+    spliceSubtrees(skeletonNode.aboveChildIdx(), skeleton, subtrees);
+    nodes[nodeIdx].initInterior(skeletonNode.splitAxis(), rightChildIdx, skeletonNode.splitPos());
+}
 
-    return hasIntersect;
+void AccelTree::addLeaf(BuildStorage& storage, const int32_t nodeIdx,
+                        const std::vector<int32_t>& triangleIndices) {
+    storage.nodes[nodeIdx].initLeaf((int32_t)storage.leafTriangleIndices.size(),
+                                    (int32_t)triangleIndices.size());
+    storage.leafTriangleIndices.insert(storage.leafTriangleIndices.end(), triangleIndices.begin(),
+                                       triangleIndices.end());
 }
 
-bool AccelTree::intersectPrim(const Ray& ray, const BBox& sceneBBox,
-                              Intersection& isectData) const {
-    std::stack<NodeIndexBBoxPair> nodesStack;
-    nodesStack.push({0, sceneBBox});
-    while (!nodesStack.empty()) {
-        const auto [currNodeIdx, currNodeBBox] = std::move(nodesStack.top());
-        nodesStack.pop();
-        const Node& currNode = nodes[currNodeIdx];
-        if (currNodeBBox.intersect(ray)) {
-            if (currNode.type == Interior) {  // stack interior nodes for traversal
-                const auto [leftChildBox, rightChildBox] =
-                    splitBBox(currNodeBBox, currNode.splitAxis, currNode.splitPos);
-                if (currNode.params.children[0] != -1) {
-                    nodesStack.push({currNode.params.children[0], leftChildBox});
-                }
-                if (currNode.params.children[1] != -1) {
-                    nodesStack.push({currNode.params.children[1], rightChildBox});
+template <typename LeafVisitor>
+bool AccelTree::traverse(const Ray& ray, LeafVisitor&& visitLeaf) const {
+    // find the parametric range of the ray that overlaps with the tree bounds
+    float tMin, tMax;
+    if (!bounds.intersect(ray, &tMin, &tMax))
+        return false;
+
+    const Vector3f invRayDir(1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z);
+    FixedStack<NodeTraversalRange, MAX_TREE_DEPTH> nodesStack;
+    int32_t currNodeIdx = 0;
+    for (;;) {
+        // skip the rest of the nodes once the ray ends before the entry point of the next node
+        if (ray.tMax >= tMin) {
+            const Node& currNode = nodes[currNodeIdx];
+            if (!currNode.isLeaf()) {
+                // order children so that the one on the ray origin side is visited first
+                const int32_t axis = currNode.splitAxis();
+                const float splitPos = currNode.splitPos();
+                const float tPlane = (splitPos - ray.origin[axis]) * invRayDir[axis];
+                const bool belowFirst = (ray.origin[axis] < splitPos) ||
+                                        (ray.origin[axis] == splitPos && ray.dir[axis] <= 0);
+                const int32_t nearChild = belowFirst ? currNodeIdx + 1 : currNode.aboveChildIdx();
+                const int32_t farChild = belowFirst ? currNode.aboveChildIdx() : currNodeIdx + 1;
+
+                // the plane distance is rounded, so a ray crossing the plane close to the range
+                // ends visits both children. Otherwise a hit on a triangle edge lying in the
+                // plane may be missed
+                const float tPlaneError = tPlane * 2 * gamma(3);
+                if (!(tPlane > 0) || tPlane - tPlaneError > tMax) {  // overlaps only near child
+                    currNodeIdx = nearChild;
+                } else if (tPlane + tPlaneError < tMin) {  // the ray overlaps only the far child
+                    currNodeIdx = farChild;
+                } else {  // stack the far child and continue with the near one
+                    nodesStack.push({farChild, tPlane, tMax});
+                    currNodeIdx = nearChild;
+                    tMax = tPlane;
                 }
-            } else {  // verify for intersection with the leaf's triangles
-                return currNode.intersectPrim(ray, isectData);
+                continue;
             }
+
+            if (visitLeaf(currNode))
+                return true;
         }
+
+        if (nodesStack.empty())
+            break;
+        const NodeTraversalRange nextNode = nodesStack.pop();
+        currNodeIdx = nextNode.nodeIdx;
+        tMin = nextNode.tMin;
+        tMax = nextNode.tMax;
     }
 
     return false;
 }
+
+bool AccelTree::intersect(const Ray& ray, Intersection& isectData) const {
+    const TriangleIntersector intersector(ray, isectMethod);
+    TriangleHit closestHit;
+    Mailbox<MAILBOX_SIZE> mailbox;
+    traverse(ray, [&](const Node& leaf) -> bool {
+        // search for the closest intersection with the leaf's triangles
+        if (intersectLeaf(leaf, intersector, mailbox, closestHit))
+            ray.tMax = closestHit.t;
+        return false;
+    });
+
+    // the hit attributes are computed only for the closest triangle, the hit references its
+    // position in the packed leaves
+    if (closestHit.primIdx < 0)
+        return false;
+
+    triangles[leafTriangleIndices[closestHit.primIdx]].computeIntersection(
+        ray, closestHit.t, closestHit.u, closestHit.v, isectData);
+    return true;
+}
+
+bool AccelTree::occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const {
+    // stop on the first opaque triangle hit in the leaves
+    const TriangleIntersector intersector(ray, isectMethod);
+    Mailbox<MAILBOX_SIZE> mailbox;
+    return traverse(ray, [&](const Node& leaf) -> bool {
+        return occludedByLeaf(leaf, intersector, mailbox, opaqueMaterials);
+    });
+}
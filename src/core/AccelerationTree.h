@@ -1,60 +1,220 @@
 #ifndef ACCELERATIONTREE_H
 #define ACCELERATIONTREE_H
 
+#include <array>
+#include <string>
 #include <vector>
+#include "Accelerator.h"
+#include "TrianglePacket.h"
 #include "Utils.h"
 
-struct Ray;
-struct Intersection;
 struct Triangle;
+class ThreadPool;
 
-enum NodeType { Interior, Leaf };
-enum class SplitMethod { Middle, SAH };
+class AccelTree : public Accelerator {
+private:
+    /// @brief Compact 8 bytes node. Interior nodes keep the split position, the split axis and the
+    /// index of their above child, the below child is always stored right after its parent.
+    /// Leaves keep a range in the flat array of leaf triangle indices
+    struct Node {
+        /// @brief Initializes leaf node that references _numPrims_ triangle indices starting
+        /// at _primsOffset_
+        void initLeaf(const int32_t primsOffset, const int32_t numPrims) {
+            leafPrimsOffset = primsOffset;
+            flags = 3;
+            nPrims |= (numPrims << 2);
+        }
+
+        /// @brief Initializes interior node split at _splitPos_ along _axis_
+        void initInterior(const int32_t axis, const int32_t aboveChildIdx, const float splitPos) {
+            split = splitPos;
+            flags = axis;
+            aboveChild |= (aboveChildIdx << 2);
+        }
+
+        float splitPos() const { return split; }
+
+        int32_t splitAxis() const { return flags & 3; }
+
+        bool isLeaf() const { return (flags & 3) == 3; }
+
+        int32_t numPrims() const { return nPrims >> 2; }
+
+        int32_t primsOffset() const { return leafPrimsOffset; }
+
+        int32_t aboveChildIdx() const { return aboveChild >> 2; }
+
+        union {
+            float split;              ///< Interior: position of the split plane
+            int32_t leafPrimsOffset;  ///< Leaf: offset of the first triangle index of the leaf
+        };
+        union {
+            int32_t flags;       ///< The two low bits keep the split axis or 3 for leaf nodes
+            int32_t nPrims;      ///< Leaf: number of triangles kept in the upper 30 bits
+            int32_t aboveChild;  ///< Interior: index of the above child kept in the upper 30 bits
+        };
+    };
+    static_assert(sizeof(Node) == 8, "AccelTree::Node is expected to be 8 bytes");
 
-/// @brief Shared storage for interior and leaf nodes
-union NodeParams {
-    int children[2]{-1, -1};
-    std::vector<Triangle>* nodeTriangles;
-};
+    /// @brief Receives the nodes and the leaf triangle indices of a (sub)tree build
+    struct BuildStorage {
+        std::vector<Node> nodes;
+        std::vector<int32_t> leafTriangleIndices;
+    };
 
-class AccelTree {
-private:
-    struct alignas(32) Node {
-        Node(const int32_t _parentId, const int8_t _splitAxis, const NodeType _nodeType,
-             const NodeParams _nodeParams);
+    /// @brief Position where the bounds of a triangle start, end or lie in plane along an axis
+    struct SplitEvent {
+        enum EventType : int32_t { End, Planar, Start };
+
+        /// @brief Strict total order - by position, then ending before planar before starting
+        /// events and finally by triangle. Partitioning a sorted list keeps it sorted
+        bool operator<(const SplitEvent& other) const {
+            if (pos != other.pos)
+                return pos < other.pos;
+            if (type != other.type)
+                return type < other.type;
+            return primIdx < other.primIdx;
+        }
+
+        float pos;        ///< Position of the event along the axis
+        int32_t primIdx;  ///< Index of the triangle in the triangle list of the node
+        EventType type;   ///< Type of the event
+    };
 
-        bool intersect(const Ray& ray, Intersection& isectData) const;
+    /// @brief Node under construction
+    struct BuildNode {
+        int32_t depth;                         ///< Depth of the node in the tree
+        int32_t badRefines;                    ///< Splits on the path that cost more than a leaf
+        BBox bbox;                             ///< Bounds of the node
+        std::vector<int32_t> triangleIndices;  ///< Triangles overlapping the node bounds
+        std::array<std::vector<SplitEvent>, 3> events;  ///< Sorted events per axis (EventSAH)
+    };
 
-        bool intersectPrim(const Ray& ray, Intersection& isectData) const;
+    /// @brief Split plane chosen for interior node
+    struct SplitPlane {
+        int32_t axis = -1;        ///< Split axis
+        float pos = Infinity;     ///< Position of the plane along the split axis
+        bool planarBelow = true;  ///< Whether triangles in the plane go below it (EventSAH)
+        int32_t badRefines = 0;   ///< Bad refines on the path including this split
+    };
 
-        NodeParams params;
-        int32_t parentId;
-        int32_t splitAxis;
-        NodeType type;
-        float splitPos = Infinity;
+    /// @brief Subtree whose construction is deferred to a worker during parallel build
+    struct Subtree {
+        BuildNode node;         ///< Root of the subtree
+        BuildStorage storage;  ///< The built subtree
     };
 
 public:
-    AccelTree(const std::vector<Triangle>& sceneTriangles, const BBox& sceneBBox);
+    /// @brief Builds the tree over _sceneTriangles_. When _pool_ is given the construction of the
+    /// subtrees is distributed among its workers, producing the same tree as the serial build.
+    /// With cache file in the settings, a tree built from the same triangles and settings is
+    /// loaded from it instead, otherwise the built tree is stored in it
+    AccelTree(std::vector<Triangle> sceneTriangles, const BBox& sceneBBox,
+              const AccelTreeSettings& treeSettings, ThreadPool* pool = nullptr);
 
-    ~AccelTree() { clearTree(); }
+    bool intersect(const Ray& ray, Intersection& isectData) const override;
 
-    bool intersect(const Ray& ray, const BBox& sceneBBox, Intersection& isectData) const;
+    bool occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const override;
 
-    bool intersectPrim(const Ray& ray, const BBox& sceneBBox, Intersection& isectData) const;
+    void setTriangleIntersection(const TriangleIntersection method) override;
 
 private:
-    void buildAccelTree(const int32_t parentIdx, const int32_t depth,
-                        const std::vector<Triangle>& triangles,
-                        const std::vector<BBox>& trianglesBBoxes, const BBox& nodeBBox);
-
-    int32_t addNode(const Node& node);
-
-    void clearTree();
+    /// @brief Walks the nodes overlapped by _ray_ in front-to-back order and calls _visitLeaf_
+    /// for each reached leaf. Stops and returns true as soon as _visitLeaf_ returns true
+    template <typename LeafVisitor>
+    bool traverse(const Ray& ray, LeafVisitor&& visitLeaf) const;
+
+    /// @brief Updates _closestHit_ with the triangles of _leaf_ hit by the ray of _intersector_
+    /// closer than it. Returns true if any was closer. Triangles recorded in _mailbox_ were
+    /// already tested against the ray in another leaf and are skipped
+    bool intersectLeaf(const Node& leaf, const TriangleIntersector& intersector,
+                       Mailbox<MAILBOX_SIZE>& mailbox, TriangleHit& closestHit) const;
+
+    /// @brief Verifies if the ray of _intersector_ is blocked by any opaque triangle of _leaf_
+    /// not recorded in _mailbox_
+    bool occludedByLeaf(const Node& leaf, const TriangleIntersector& intersector,
+                        Mailbox<MAILBOX_SIZE>& mailbox,
+                        const OpaqueMaterials& opaqueMaterials) const;
+
+    /// @brief Creates the sorted split events of all triangles in _root_ along each axis,
+    /// sorting them on _pool_ if given
+    static void initSplitEvents(BuildNode& root, const std::vector<BBox>& trianglesBBoxes,
+                                ThreadPool* pool);
+
+    /// @brief Finds split plane for _node_. Returns false if the node should be leaf. Large nodes
+    /// sort their split candidates on _pool_ if given
+    bool findSplit(const BuildNode& node, const std::vector<BBox>& trianglesBBoxes,
+                   ThreadPool* pool, SplitPlane& split) const;
+
+    /// @brief Finds the cheapest split plane of _node_ along all axes by sweeping its events
+    bool findEventSplit(const BuildNode& node, SplitPlane& split) const;
+
+    /// @brief Computes the SAH cost of splitting _nodeBBox_ at _splitPos_ along _axis_ with
+    /// _numBelow_ and _numAbove_ triangles on each side
+    float computeSplitCost(const BBox& nodeBBox, const float invNodeSurfArea, const int32_t axis,
+                           const float splitPos, const int32_t numBelow,
+                           const int32_t numAbove) const;
+
+    /// @brief Decides if the best found _split_ of _node_ is worth it. Returns false if the
+    /// node should be leaf
+    bool acceptSplit(const BuildNode& node, const float bestSplitCost, SplitPlane& split) const;
+
+    /// @brief Distributes the triangles (and events) of _node_ among its children at _split_.
+    /// Releases the events of _node_
+    void splitNode(BuildNode& node, const SplitPlane& split,
+                   const std::vector<BBox>& trianglesBBoxes, BuildNode& below,
+                   BuildNode& above) const;
+
+    /// @brief Recursively builds (sub)tree rooted at _node_ into _storage_
+    void buildAccelTree(BuildNode& node, const std::vector<BBox>& trianglesBBoxes,
+                        BuildStorage& storage) const;
+
+    /// @brief Splits the large nodes at the top of the tree into _skeleton_. Nodes with fewer
+    /// triangles than PARALLEL_BUILD_MIN_TRIANGLES become skeleton leaves that reference
+    /// _subtrees_ to be built in parallel
+    void buildTopLevels(BuildNode& node, const std::vector<BBox>& trianglesBBoxes,
+                        std::vector<Node>& skeleton, std::vector<Subtree>& subtrees,
+                        ThreadPool& pool) const;
+
+    /// @brief Appends the nodes of _skeleton_ and the built _subtrees_ to the tree in
+    /// depth-first order
+    void spliceSubtrees(const int32_t skeletonIdx, const std::vector<Node>& skeleton,
+                        std::vector<Subtree>& subtrees);
+
+    /// @brief Tests the up to TRIANGLE_PACKET_WIDTH triangles of a packet with indices
+    /// _packetIndices_ against _mailbox_, out of the _numPrims_ remaining in the leaf. Returns
+    /// bitmask of the lanes not tested against the ray yet
+    static int32_t testPacketMailbox(const int32_t* packetIndices, const int32_t numPrims,
+                                     Mailbox<MAILBOX_SIZE>& mailbox);
+
+    /// @brief Stores the leaves' triangles in SoA packets of TRIANGLE_PACKET_WIDTH records.
+    /// Each leaf is moved to start at packet boundary in the leaf triangle indices
+    void packLeaves();
+
+    /// @brief Fills the lanes of the leaf packets with the records of their triangles for the
+    /// selected intersection method
+    void updateLeafPackets();
+
+    /// @brief Computes the key of the cached tree from the triangles and the build settings
+    uint64_t computeCacheKey() const;
+
+    /// @brief Loads the tree from the cache file if it was stored with _cacheKey_
+    bool loadCache(const uint64_t cacheKey);
+
+    /// @brief Stores the tree in the cache file along with _cacheKey_
+    void saveCache(const uint64_t cacheKey) const;
+
+    /// @brief Initializes leaf node in _storage_ that references _triangleIndices_
+    static void addLeaf(BuildStorage& storage, const int32_t nodeIdx,
+                        const std::vector<int32_t>& triangleIndices);
 
 private:
-    std::vector<Node> nodes;  ///< Flattened nodes of the acceleration tree
-    const SplitMethod splitMethod = SplitMethod::SAH;  ///< Split method used to build the tree
+    std::vector<Node> nodes;                          ///< Flattened nodes of the tree
+    std::vector<Triangle> triangles;                  ///< Triangles referenced by the leaves
+    std::vector<int32_t> leafTriangleIndices;         ///< Leaves' triangle indices
+    std::vector<TrianglePacket> leafPackets;          ///< Leaves' triangles in SoA packets
+    const BBox bounds;                                ///< Bounds of the tree
+    const AccelTreeSettings settings;                 ///< Settings used to build the tree
 };
 
 #endif  // !ACCELERATIONTREE_H
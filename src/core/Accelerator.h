@@ -0,0 +1,50 @@
+#ifndef ACCELERATOR_H
+#define ACCELERATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "AccelSettings.h"
+#include "Triangle.h"
+
+class ThreadPool;
+
+/// @brief Opaque flag per material index used by occlusion queries. Triangles with transparent
+/// materials let the ray through, an empty list marks all materials as opaque
+using OpaqueMaterials = std::vector<bool>;
+
+/// @brief Verifies if material _materialIdx_ blocks occlusion queries
+inline bool isOpaque(const OpaqueMaterials& opaqueMaterials, const int32_t materialIdx) {
+    return opaqueMaterials.empty() || opaqueMaterials[materialIdx];
+}
+
+/// @brief Common interface of the acceleration structures that answer the scene's ray queries
+class Accelerator {
+public:
+    virtual ~Accelerator() = default;
+
+    /// @brief Finds the closest intersection of _ray_ with the triangles if any
+    virtual bool intersect(const Ray& ray, Intersection& isectData) const = 0;
+
+    /// @brief Verifies if _ray_ is blocked by any triangle with a material marked in
+    /// _opaqueMaterials_. Returns true on the first such triangle found and continues past the
+    /// transparent ones, no hit attributes are computed
+    virtual bool occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const = 0;
+
+    /// @brief Verifies if the structure can be updated by refit() when its triangles move
+    virtual bool canRefit() const { return false; }
+
+    /// @brief Updates the structure after the vertices of its triangles moved, in parallel on
+    /// _pool_ if given. Returns false if the structure can't be updated and must be built again
+    virtual bool refit(ThreadPool* pool) { return false; }
+
+    /// @brief Selects the ray-triangle intersection method of the queries. Structures keeping
+    /// triangle records make them again for the method
+    virtual void setTriangleIntersection(const TriangleIntersection method) {
+        isectMethod = method;
+    }
+
+protected:
+    TriangleIntersection isectMethod = TriangleIntersection::MollerTrumbore;  ///< Query method
+};
+
+#endif  // !ACCELERATOR_H
@@ -0,0 +1,541 @@
+/// Own includes
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+/// System headers
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <iostream>
+
+/// @brief Calls _func_(chunk) for each of _numChunks_ chunks of work, in parallel on _pool_ if
+/// given
+template <typename F>
+static void forEachChunk(const size_t numChunks, ThreadPool* pool, F&& func) {
+    if (pool) {
+        pool->parallelFor(numChunks, func);
+    } else {
+        for (size_t chunk = 0; chunk < numChunks; chunk++)
+            func(chunk);
+    }
+}
+
+/// @brief Spreads the lower 10 bits of _x_ apart so that two zero bits separate each of them
+/// source https://github.com/mmp/pbrt-v3/blob/master/src/accelerators/bvh.cpp
+inline static uint32_t leftShift3(uint32_t x) {
+    if (x == (1 << 10))
+        --x;
+    x = (x | (x << 16)) & 0b00000011000000000000000011111111;
+    x = (x | (x << 8)) & 0b00000011000000001111000000001111;
+    x = (x | (x << 4)) & 0b00000011000011000011000011000011;
+    x = (x | (x << 2)) & 0b00001001001001001001001001001001;
+    return x;
+}
+
+/// @brief Interleaves the bits of the quantized point _p_ with coordinates in [0, 1024]
+inline static uint32_t encodeMorton3(const Vector3f& p) {
+    return (leftShift3((uint32_t)p.z) << 2) | (leftShift3((uint32_t)p.y) << 1) |
+           leftShift3((uint32_t)p.x);
+}
+
+BVH::BVH(std::vector<Triangle> sceneTriangles, const BVHSettings& bvhSettings, ThreadPool* pool)
+    : triangles(std::move(sceneTriangles)), settings(bvhSettings) {
+    Timer timer;
+    std::cout << "Start building BVH...\n";
+    timer.start();
+    build(computeTriangleBounds(pool), pool);
+
+    const size_t bvhBytes = tree.getNodes().size() * sizeof(BVHTree::Node);
+    std::cout << "BVH with " << tree.getNodes().size() << " nodes [" << bvhBytes / 1024
+              << "KB] build for [" << std::fixed << std::setprecision(2)
+              << Timer::toMilliSec<float>(timer.getElapsedNanoSec()) << "ms]\n";
+}
+
+void BVH::build(const std::vector<BBox>& triangleBounds, ThreadPool* pool) {
+    // each triangle ends up in exactly one leaf, store them in the order the leaves use
+    const std::vector<int32_t> leafOrder = tree.build(triangleBounds, settings, pool);
+    std::vector<Triangle> leafTriangles;
+    leafTriangles.reserve(triangles.size());
+    for (const int32_t triangleIdx : leafOrder)
+        leafTriangles.push_back(triangles[triangleIdx]);
+    triangles = std::move(leafTriangles);
+    updateTriangleRecords(pool);
+    builtSAHCost = tree.computeSAHCost();
+}
+
+void BVH::updateTriangleRecords(ThreadPool* pool) {
+    triangleRecords.resize(triangles.size());
+    const size_t numChunks = pool ? pool->getThreadsCount() : 1;
+    forEachChunk(numChunks, pool, [&](const size_t chunk) {
+        const size_t chunkEnd = triangles.size() * (chunk + 1) / numChunks;
+        for (size_t i = triangles.size() * chunk / numChunks; i < chunkEnd; i++)
+            triangleRecords[i] = TriangleRecord(triangles[i], isectMethod);
+    });
+}
+
+void BVH::setTriangleIntersection(const TriangleIntersection method) {
+    if (method == isectMethod)
+        return;
+
+    Accelerator::setTriangleIntersection(method);
+    updateTriangleRecords(nullptr);
+}
+
+std::vector<BBox> BVH::computeTriangleBounds(ThreadPool* pool) const {
+    std::vector<BBox> triangleBounds(triangles.size());
+    const size_t numChunks = pool ? pool->getThreadsCount() : 1;
+    forEachChunk(numChunks, pool, [&](const size_t chunk) {
+        const size_t chunkEnd = triangles.size() * (chunk + 1) / numChunks;
+        for (size_t i = triangles.size() * chunk / numChunks; i < chunkEnd; i++)
+            triangleBounds[i] = getTriangleBBox(triangles[i]);
+    });
+    return triangleBounds;
+}
+
+bool BVH::refit(ThreadPool* pool) {
+    Timer timer;
+    timer.start();
+    const std::vector<BBox> triangleBounds = computeTriangleBounds(pool);
+    tree.refit(triangleBounds, pool);
+
+    // the topology is kept while the SAH cost stays close to the one of a fresh build
+    const float sahCostRatio = builtSAHCost > 0 ? tree.computeSAHCost() / builtSAHCost : 1.f;
+    const bool rebuild = sahCostRatio > settings.rebuildThreshold;
+    if (rebuild)
+        build(triangleBounds, pool);
+    else
+        updateTriangleRecords(pool);
+
+    std::cout << "BVH " << (rebuild ? "rebuilt" : "refit") << " with SAH cost ratio "
+              << std::fixed << std::setprecision(2) << sahCostRatio << " for ["
+              << Timer::toMilliSec<float>(timer.getElapsedNanoSec()) << "ms]\n";
+    return true;
+}
+
+std::vector<int32_t> BVHTree::build(const std::vector<BBox>& primBounds,
+                                    const BVHSettings& bvhSettings, ThreadPool* pool) {
+    settings = bvhSettings;
+    if (settings.builder == BVHBuilder::LBVH)
+        return buildLinear(primBounds, pool);
+
+    // compute the centroid of each primitive's bounds
+    std::vector<PrimInfo> primInfos(primBounds.size());
+    for (size_t i = 0; i < primBounds.size(); i++) {
+        primInfos[i].primIdx = (int32_t)i;
+        primInfos[i].bounds = primBounds[i];
+        primInfos[i].centroid = (primBounds[i].min + primBounds[i].max) * 0.5f;
+    }
+
+    // the leaves are ranges of the partitioned primitives, so their final order is leaf order
+    nodes.clear();
+    nodes.reserve(2 * primInfos.size());
+    if (!primInfos.empty())
+        buildRecursive(primInfos, 0, (int32_t)primInfos.size(), 0);
+    nodes.shrink_to_fit();
+
+    std::vector<int32_t> leafOrder(primInfos.size());
+    for (size_t i = 0; i < primInfos.size(); i++)
+        leafOrder[i] = primInfos[i].primIdx;
+    return leafOrder;
+}
+
+void BVHTree::buildRecursive(std::vector<PrimInfo>& primInfos, const int32_t start,
+                             const int32_t end, const int32_t depth) {
+    const int32_t nodeIdx = (int32_t)nodes.size();
+    nodes.emplace_back();
+
+    BBox nodeBounds, centroidBounds;
+    for (int32_t i = start; i < end; i++) {
+        nodeBounds.unionWith(primInfos[i].bounds);
+        centroidBounds.expandBy(primInfos[i].centroid);
+    }
+
+    // primitives with coincident centroids can't be separated, such nodes become leaves
+    const int32_t axis = findMaxExtent(centroidBounds);
+    int32_t mid = -1;
+    if (depth < BVH_MAX_DEPTH && end - start > 1 &&
+        centroidBounds.max[axis] > centroidBounds.min[axis])
+        mid = partitionSAH(primInfos, start, end, nodeBounds, centroidBounds, axis);
+
+    if (mid == -1) {
+        nodes[nodeIdx].initLeaf(nodeBounds, start, end - start);
+        return;
+    }
+
+    buildRecursive(primInfos, start, mid, depth + 1);
+    const int32_t secondChildIdx = (int32_t)nodes.size();
+    buildRecursive(primInfos, mid, end, depth + 1);
+    nodes[nodeIdx].initInterior(nodeBounds, axis, secondChildIdx);
+}
+
+std::vector<int32_t> BVHTree::buildLinear(const std::vector<BBox>& primBounds,
+                                          ThreadPool* pool) {
+    nodes.clear();
+    if (primBounds.empty())
+        return {};
+
+    const int32_t numPrims = (int32_t)primBounds.size();
+    BBox centroidBounds;
+    for (const BBox& bounds : primBounds)
+        centroidBounds.expandBy((bounds.min + bounds.max) * 0.5f);
+
+    // quantize the centroids on the grid of the Morton curve that spans their bounds
+    const Vector3f centroidExtent = centroidBounds.max - centroidBounds.min;
+    std::vector<MortonPrim> mortonPrims(numPrims);
+    const size_t numChunks = pool ? pool->getThreadsCount() : 1;
+    forEachChunk(numChunks, pool, [&](const size_t chunk) {
+        const int32_t chunkEnd = (int32_t)(numPrims * (chunk + 1) / numChunks);
+        for (int32_t i = (int32_t)(numPrims * chunk / numChunks); i < chunkEnd; i++) {
+            Vector3f gridPos = (primBounds[i].min + primBounds[i].max) * 0.5f;
+            for (int32_t axis = 0; axis < 3; axis++) {
+                gridPos[axis] = centroidExtent[axis] > 0
+                                    ? (gridPos[axis] - centroidBounds.min[axis]) /
+                                          centroidExtent[axis] * (1 << MORTON_BITS_PER_AXIS)
+                                    : 0.f;
+            }
+            mortonPrims[i] = {encodeMorton3(gridPos), i};
+        }
+    });
+    radixSort(mortonPrims, pool);
+
+    nodes.reserve(2 * numPrims);
+    constexpr int32_t topBitIndex = 3 * MORTON_BITS_PER_AXIS - 1;
+    if (!settings.optimizeTreelets) {
+        emitLBVH(nodes, mortonPrims, primBounds, 0, numPrims, topBitIndex);
+    } else {
+        // the primitives that share the top bits of their codes are close to each other and
+        // form treelets, which are independent and are built in parallel
+        constexpr uint32_t treeletMask = ((1u << LBVH_TREELET_BITS) - 1)
+                                         << (3 * MORTON_BITS_PER_AXIS - LBVH_TREELET_BITS);
+        std::vector<int32_t> treeletStarts;
+        for (int32_t i = 0; i < numPrims; i++) {
+            if (i == 0 || ((mortonPrims[i].mortonCode ^ mortonPrims[i - 1].mortonCode) &
+                           treeletMask) != 0)
+                treeletStarts.push_back(i);
+        }
+        treeletStarts.push_back(numPrims);
+
+        const size_t numTreelets = treeletStarts.size() - 1;
+        std::vector<std::vector<Node>> treeletNodes(numTreelets);
+        std::vector<PrimInfo> treeletInfos(numTreelets);
+        forEachChunk(numTreelets, pool, [&](const size_t i) {
+            treeletInfos[i].primIdx = (int32_t)i;
+            treeletInfos[i].bounds =
+                emitLBVH(treeletNodes[i], mortonPrims, primBounds, treeletStarts[i],
+                         treeletStarts[i + 1], topBitIndex - LBVH_TREELET_BITS);
+            treeletInfos[i].centroid =
+                (treeletInfos[i].bounds.min + treeletInfos[i].bounds.max) * 0.5f;
+        });
+
+        // the few levels above the treelets decide most of the traversal cost
+        buildUpperSAH(treeletInfos, 0, (int32_t)numTreelets, 0, treeletNodes);
+    }
+    nodes.shrink_to_fit();
+
+    std::vector<int32_t> leafOrder(numPrims);
+    for (int32_t i = 0; i < numPrims; i++)
+        leafOrder[i] = mortonPrims[i].primIdx;
+    return leafOrder;
+}
+
+void BVHTree::radixSort(std::vector<MortonPrim>& mortonPrims, ThreadPool* pool) {
+    constexpr int32_t numBuckets = 1 << RADIX_SORT_BITS_PER_PASS;
+    constexpr int32_t numPasses =
+        (3 * MORTON_BITS_PER_AXIS + RADIX_SORT_BITS_PER_PASS - 1) / RADIX_SORT_BITS_PER_PASS;
+    const size_t size = mortonPrims.size();
+    const size_t numChunks = pool ? pool->getThreadsCount() : 1;
+    std::vector<MortonPrim> sortedPrims(size);
+    std::vector<std::array<size_t, numBuckets>> chunkOffsets(numChunks);
+    for (int32_t pass = 0; pass < numPasses; pass++) {
+        const int32_t lowBit = pass * RADIX_SORT_BITS_PER_PASS;
+        const auto getBucket = [lowBit](const MortonPrim& mortonPrim) {
+            return (mortonPrim.mortonCode >> lowBit) & (numBuckets - 1);
+        };
+
+        // count the codes of each chunk per bucket
+        forEachChunk(numChunks, pool, [&](const size_t chunk) {
+            std::array<size_t, numBuckets>& bucketCounts = chunkOffsets[chunk];
+            bucketCounts.fill(0);
+            for (size_t i = size * chunk / numChunks; i < size * (chunk + 1) / numChunks; i++)
+                bucketCounts[getBucket(mortonPrims[i])]++;
+        });
+
+        // within each bucket the chunks are placed in order, which keeps the sort stable
+        size_t offset = 0;
+        for (int32_t bucket = 0; bucket < numBuckets; bucket++) {
+            for (size_t chunk = 0; chunk < numChunks; chunk++) {
+                const size_t bucketCount = chunkOffsets[chunk][bucket];
+                chunkOffsets[chunk][bucket] = offset;
+                offset += bucketCount;
+            }
+        }
+
+        forEachChunk(numChunks, pool, [&](const size_t chunk) {
+            std::array<size_t, numBuckets>& bucketOffsets = chunkOffsets[chunk];
+            for (size_t i = size * chunk / numChunks; i < size * (chunk + 1) / numChunks; i++)
+                sortedPrims[bucketOffsets[getBucket(mortonPrims[i])]++] = mortonPrims[i];
+        });
+        mortonPrims.swap(sortedPrims);
+    }
+}
+
+BBox BVHTree::emitLBVH(std::vector<Node>& lbvhNodes, const std::vector<MortonPrim>& mortonPrims,
+                       const std::vector<BBox>& primBounds, const int32_t start,
+                       const int32_t end, int32_t bitIndex) const {
+    // the codes in the range are sorted and share the bits above _bitIndex_, skip the bits that
+    // are also equal for the first and the last code since they don't separate the range
+    const uint32_t rangeBits = mortonPrims[start].mortonCode ^ mortonPrims[end - 1].mortonCode;
+    while (bitIndex >= 0 && !(rangeBits & (1u << bitIndex)))
+        bitIndex--;
+
+    const int32_t nodeIdx = (int32_t)lbvhNodes.size();
+    lbvhNodes.emplace_back();
+    if (end - start <= settings.maxLeafTriangles || bitIndex < 0) {
+        BBox leafBounds;
+        for (int32_t i = start; i < end; i++)
+            leafBounds.unionWith(primBounds[mortonPrims[i].primIdx]);
+        lbvhNodes[nodeIdx].initLeaf(leafBounds, start, end - start);
+        return leafBounds;
+    }
+
+    // the second child starts at the first code with the bit set, the bits cycle x, y, z
+    const uint32_t bitMask = 1u << bitIndex;
+    const auto midIt = std::partition_point(
+        mortonPrims.begin() + start, mortonPrims.begin() + end,
+        [bitMask](const MortonPrim& mortonPrim) { return !(mortonPrim.mortonCode & bitMask); });
+    const int32_t mid = (int32_t)(midIt - mortonPrims.begin());
+
+    BBox nodeBounds = emitLBVH(lbvhNodes, mortonPrims, primBounds, start, mid, bitIndex - 1);
+    const int32_t secondChildIdx = (int32_t)lbvhNodes.size();
+    nodeBounds.unionWith(emitLBVH(lbvhNodes, mortonPrims, primBounds, mid, end, bitIndex - 1));
+    lbvhNodes[nodeIdx].initInterior(nodeBounds, bitIndex % 3, secondChildIdx);
+    return nodeBounds;
+}
+
+void BVHTree::buildUpperSAH(std::vector<PrimInfo>& treeletInfos, const int32_t start,
+                            const int32_t end, const int32_t depth,
+                            const std::vector<std::vector<Node>>& treeletNodes) {
+    if (end - start == 1) {
+        // the treelet's nodes are appended as they are, only the child indices are moved
+        const int32_t nodesOffset = (int32_t)nodes.size();
+        for (Node node : treeletNodes[treeletInfos[start].primIdx]) {
+            if (!node.isLeaf())
+                node.offset += nodesOffset;
+            nodes.push_back(node);
+        }
+        return;
+    }
+
+    const int32_t nodeIdx = (int32_t)nodes.size();
+    nodes.emplace_back();
+
+    BBox nodeBounds, centroidBounds;
+    for (int32_t i = start; i < end; i++) {
+        nodeBounds.unionWith(treeletInfos[i].bounds);
+        centroidBounds.expandBy(treeletInfos[i].centroid);
+    }
+
+    // every treelet needs its own leaf, so the split falls back to equal counts where SAH
+    // finds none. Deep upper levels leave no room for the treelets below, they are split
+    // by counts as well
+    const int32_t axis = findMaxExtent(centroidBounds);
+    int32_t mid = -1;
+    if (depth < BVH_MAX_DEPTH - 3 * MORTON_BITS_PER_AXIS - LBVH_TREELET_BITS &&
+        centroidBounds.max[axis] > centroidBounds.min[axis])
+        mid = partitionSAH(treeletInfos, start, end, nodeBounds, centroidBounds, axis);
+    if (mid == -1) {
+        mid = (start + end) / 2;
+        std::nth_element(treeletInfos.begin() + start, treeletInfos.begin() + mid,
+                         treeletInfos.begin() + end, [axis](const PrimInfo& a, const PrimInfo& b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+    }
+
+    buildUpperSAH(treeletInfos, start, mid, depth + 1, treeletNodes);
+    const int32_t secondChildIdx = (int32_t)nodes.size();
+    buildUpperSAH(treeletInfos, mid, end, depth + 1, treeletNodes);
+    nodes[nodeIdx].initInterior(nodeBounds, axis, secondChildIdx);
+}
+
+void BVHTree::refit(const std::vector<BBox>& primBounds, ThreadPool* pool) {
+    if (nodes.empty())
+        return;
+
+    // split the top of the hierarchy into subtrees, a few per thread, that are refit
+    // independently. Nodes follow their parents in depth-first order, so refitting each range
+    // backwards updates the children before their parents
+    std::vector<int32_t> subtreeRoots, topNodes;
+    int32_t splitDepth = 0;
+    while (pool && (1u << splitDepth) < 4 * pool->getThreadsCount())
+        splitDepth++;
+    std::vector<std::pair<int32_t, int32_t>> pendingNodes{{0, 0}};  // node index and depth
+    while (!pendingNodes.empty()) {
+        const auto [nodeIdx, depth] = pendingNodes.back();
+        pendingNodes.pop_back();
+        if (depth == splitDepth || nodes[nodeIdx].isLeaf()) {
+            subtreeRoots.push_back(nodeIdx);
+            continue;
+        }
+        topNodes.push_back(nodeIdx);
+        pendingNodes.emplace_back(nodeIdx + 1, depth + 1);
+        pendingNodes.emplace_back(nodes[nodeIdx].secondChildIdx(), depth + 1);
+    }
+
+    forEachChunk(subtreeRoots.size(), pool, [&](const size_t i) {
+        for (int32_t nodeIdx = subtreeEnd(subtreeRoots[i]) - 1; nodeIdx >= subtreeRoots[i];
+             nodeIdx--)
+            refitNode(nodeIdx, primBounds);
+    });
+
+    // the nodes above the subtrees were collected before their children
+    for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it)
+        refitNode(*it, primBounds);
+}
+
+void BVHTree::refitNode(const int32_t nodeIdx, const std::vector<BBox>& primBounds) {
+    Node& node = nodes[nodeIdx];
+    BBox nodeBounds;
+    if (node.isLeaf()) {
+        for (int32_t i = node.primsOffset(); i < node.primsOffset() + node.numPrims(); i++)
+            nodeBounds.unionWith(primBounds[i]);
+    } else {
+        nodeBounds = nodes[nodeIdx + 1].getBounds();
+        nodeBounds.unionWith(nodes[node.secondChildIdx()].getBounds());
+    }
+    node.setBounds(nodeBounds);
+}
+
+int32_t BVHTree::subtreeEnd(int32_t nodeIdx) const {
+    // the last node of a subtree is the leaf reached by following the second children
+    while (!nodes[nodeIdx].isLeaf())
+        nodeIdx = nodes[nodeIdx].secondChildIdx();
+    return nodeIdx + 1;
+}
+
+float BVHTree::computeSAHCost() const {
+    if (nodes.empty())
+        return 0.f;
+
+    float sahCost = 0.f;
+    for (const Node& node : nodes) {
+        const float nodeSurfArea = surfaceArea(node.getBounds());
+        sahCost += node.isLeaf() ? settings.isectCost * node.numPrims() * nodeSurfArea
+                                 : settings.traversalCost * nodeSurfArea;
+    }
+    const float rootSurfArea = surfaceArea(nodes[0].getBounds());
+    return rootSurfArea > 0 ? sahCost / rootSurfArea : 0.f;
+}
+
+int32_t BVHTree::partitionSAH(std::vector<PrimInfo>& primInfos, const int32_t start,
+                              const int32_t end, const BBox& nodeBounds,
+                              const BBox& centroidBounds, const int32_t axis) const {
+    struct Bin {
+        int32_t count = 0;
+        BBox bounds;
+    };
+
+    // distribute the primitives into equally sized bins by their centroids
+    const int32_t numBins = std::clamp(settings.numBins, 2, MAX_BVH_BINS);
+    const float centroidMin = centroidBounds.min[axis];
+    const float binScale = numBins / (centroidBounds.max[axis] - centroidMin);
+    const auto getBinIdx = [&](const PrimInfo& primInfo) {
+        const int32_t binIdx = (int32_t)((primInfo.centroid[axis] - centroidMin) * binScale);
+        return std::min(binIdx, numBins - 1);
+    };
+
+    std::array<Bin, MAX_BVH_BINS> bins;
+    for (int32_t i = start; i < end; i++) {
+        Bin& bin = bins[getBinIdx(primInfos[i])];
+        bin.count++;
+        bin.bounds.unionWith(primInfos[i].bounds);
+    }
+
+    // sweep the bins from both sides to find the area weighted primitive counts of each split
+    std::array<float, MAX_BVH_BINS> belowCosts, aboveCosts;
+    BBox belowBounds, aboveBounds;
+    int32_t numBelow = 0, numAbove = 0;
+    for (int32_t i = 0; i < numBins - 1; i++) {
+        belowBounds.unionWith(bins[i].bounds);
+        numBelow += bins[i].count;
+        belowCosts[i] = numBelow ? numBelow * surfaceArea(belowBounds) : 0.f;
+
+        const int32_t aboveBin = numBins - 1 - i;
+        aboveBounds.unionWith(bins[aboveBin].bounds);
+        numAbove += bins[aboveBin].count;
+        aboveCosts[aboveBin - 1] = numAbove ? numAbove * surfaceArea(aboveBounds) : 0.f;
+    }
+
+    float bestSplitCost = Infinity;
+    int32_t bestSplitBin = -1;
+    const float invNodeSurfArea = 1.f / surfaceArea(nodeBounds);
+    for (int32_t i = 0; i < numBins - 1; i++) {
+        const float splitCost =
+            settings.traversalCost +
+            settings.isectCost * (belowCosts[i] + aboveCosts[i]) * invNodeSurfArea;
+        if (splitCost < bestSplitCost) {
+            bestSplitCost = splitCost;
+            bestSplitBin = i;
+        }
+    }
+
+    // small nodes become leaves if splitting them doesn't pay off
+    const int32_t numPrims = end - start;
+    const float leafCost = settings.isectCost * numPrims;
+    if (numPrims <= settings.maxLeafTriangles && bestSplitCost >= leafCost)
+        return -1;
+
+    const auto midIt = std::partition(
+        primInfos.begin() + start, primInfos.begin() + end,
+        [&](const PrimInfo& primInfo) { return getBinIdx(primInfo) <= bestSplitBin; });
+    int32_t mid = (int32_t)(midIt - primInfos.begin());
+    if (mid == start || mid == end) {  // fall back to equal counts if the split is degenerate
+        mid = (start + end) / 2;
+        std::nth_element(primInfos.begin() + start, primInfos.begin() + mid,
+                         primInfos.begin() + end, [axis](const PrimInfo& a, const PrimInfo& b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+    }
+    return mid;
+}
+
+bool BVH::intersect(const Ray& ray, Intersection& isectData) const {
+    const TriangleIntersector intersector(ray, isectMethod);
+    TriangleHit closestHit;
+    tree.traverse(ray, [&](const BVHTree::Node& leaf) -> bool {
+        // search for the closest intersection with the leaf's triangles
+        const int32_t primsEnd = leaf.primsOffset() + leaf.numPrims();
+        for (int32_t i = leaf.primsOffset(); i < primsEnd; ++i) {
+            float t, u, v;
+            if (intersector.intersect(triangleRecords[i], t, u, v) && t < closestHit.t) {
+                closestHit = {t, u, v, i};
+                ray.tMax = t;
+            }
+        }
+        return false;
+    });
+
+    // the hit attributes are computed only for the closest triangle
+    if (closestHit.primIdx < 0)
+        return false;
+
+    const int32_t primIdx = closestHit.primIdx;
+    triangles[primIdx].computeIntersection(ray, closestHit.t, closestHit.u, closestHit.v,
+                                           isectData);
+    return true;
+}
+
+bool BVH::occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const {
+    // stop on the first opaque triangle hit, the material is looked up only for the hits
+    const TriangleIntersector intersector(ray, isectMethod);
+    return tree.traverse(ray, [&](const BVHTree::Node& leaf) -> bool {
+        const int32_t primsEnd = leaf.primsOffset() + leaf.numPrims();
+        for (int32_t i = leaf.primsOffset(); i < primsEnd; ++i) {
+            float t, u, v;
+            if (intersector.intersect(triangleRecords[i], t, u, v) &&
+                isOpaque(opaqueMaterials, triangles[i].mesh->materialIdx))
+                return true;
+        }
+        return false;
+    });
+}
@@ -0,0 +1,244 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "Accelerator.h"
+#include "Utils.h"
+
+/// @brief Binary BVH built with binned SAH over primitives known only by their bounds. Holds the
+/// nodes shared by the triangle BVH and the top level of the two-level structure, the leaves
+/// reference ranges of the primitives in the order given by build
+class BVHTree {
+public:
+    /// @brief 32 bytes node stored in depth-first order. The first child of interior node
+    /// follows its parent, the second child is referenced by index. Leaves keep a range of the
+    /// reordered primitives. The bounds are kept as plain floats since BBox is padded to 32 bytes
+    struct Node {
+        /// @brief Initializes leaf node that references _numPrims_ primitives starting at
+        /// _primsOffset_
+        void initLeaf(const BBox& nodeBounds, const int32_t primsOffset, const int32_t numPrims) {
+            setBounds(nodeBounds);
+            offset = primsOffset;
+            flags = (numPrims << 2) | 3;
+        }
+
+        /// @brief Initializes interior node split along _axis_
+        void initInterior(const BBox& nodeBounds, const int32_t axis,
+                          const int32_t secondChildIdx) {
+            setBounds(nodeBounds);
+            offset = secondChildIdx;
+            flags = axis;
+        }
+
+        int32_t splitAxis() const { return flags & 3; }
+
+        bool isLeaf() const { return (flags & 3) == 3; }
+
+        int32_t numPrims() const { return flags >> 2; }
+
+        int32_t primsOffset() const { return offset; }
+
+        int32_t secondChildIdx() const { return offset; }
+
+        BBox getBounds() const {
+            return BBox(Point3f(bounds[0][0], bounds[0][1], bounds[0][2]),
+                        Point3f(bounds[1][0], bounds[1][1], bounds[1][2]));
+        }
+
+        void setBounds(const BBox& box) {
+            for (int32_t axis = 0; axis < 3; axis++) {
+                bounds[0][axis] = box.min[axis];
+                bounds[1][axis] = box.max[axis];
+            }
+        }
+
+        /// @brief Verifies if the segment [0, ray.tMax] of _ray_ intersects with the node bounds,
+        /// using the reciprocal ray direction _invRayDir_ and its signs _dirIsNeg_
+        /// source https://github.com/mmp/pbrt-v3/blob/master/src/core/geometry.h
+        bool intersect(const Ray& ray, const Vector3f& invRayDir, const int dirIsNeg[3]) const {
+            float tMin = 0, tMax = ray.tMax;
+            for (int32_t axis = 0; axis < 3; axis++) {
+                const float tNear = (bounds[dirIsNeg[axis]][axis] - ray.origin[axis]) *
+                                    invRayDir[axis];
+                float tFar = (bounds[1 - dirIsNeg[axis]][axis] - ray.origin[axis]) *
+                             invRayDir[axis];
+                tFar *= 1 + 2 * gamma(3);  // Update tFar to ensure robust ray–bbox intersection
+                tMin = tNear > tMin ? tNear : tMin;
+                tMax = tFar < tMax ? tFar : tMax;
+                if (tMin > tMax)
+                    return false;
+            }
+            return true;
+        }
+
+        float bounds[2][3];  ///< Minimum and maximum corners of all primitives below the node
+        int32_t offset;      ///< Leaf: offset of the first primitive, interior: second child index
+        int32_t flags;       ///< The two low bits keep the split axis or 3 for leaves, the upper
+                             ///< bits keep the number of primitives of leaves
+    };
+    static_assert(sizeof(Node) == 32, "BVHTree::Node is expected to be 32 bytes");
+
+private:
+    /// @brief Primitive's bounds and their centroid used during construction
+    struct PrimInfo {
+        int32_t primIdx;   ///< Index of the primitive in the input list
+        BBox bounds;       ///< Bounds of the primitive
+        Point3f centroid;  ///< Center of the bounds
+    };
+
+    /// @brief Primitive's position along the Morton curve used by the linear build
+    struct MortonPrim {
+        uint32_t mortonCode;  ///< Interleaved bits of the quantized centroid, x is the lowest
+        int32_t primIdx;      ///< Index of the primitive in the input list
+    };
+
+public:
+    /// @brief Builds the hierarchy over primitives with bounds _primBounds_ with the builder
+    /// selected by _bvhSettings_, in parallel on _pool_ if given. Returns the input indices of the
+    /// primitives in the order the leaves reference them
+    std::vector<int32_t> build(const std::vector<BBox>& primBounds, const BVHSettings& bvhSettings,
+                               ThreadPool* pool = nullptr);
+
+    /// @brief Walks the nodes overlapped by _ray_, visiting the near child first, and calls
+    /// _visitLeaf_ for each reached leaf. Stops and returns true as soon as _visitLeaf_ returns
+    /// true
+    template <typename LeafVisitor>
+    bool traverse(const Ray& ray, LeafVisitor&& visitLeaf) const;
+
+    /// @brief Updates the bounds of all nodes bottom-up from the moved primitives' bounds
+    /// _primBounds_, given in leaf order. Independent subtrees are refit in parallel on _pool_ if
+    /// given
+    void refit(const std::vector<BBox>& primBounds, ThreadPool* pool);
+
+    /// @brief Computes the SAH cost of the hierarchy with the cost model of the build, relative
+    /// to the surface area of the root. Refitting degrades it while the topology stays the same
+    float computeSAHCost() const;
+
+    const std::vector<Node>& getNodes() const { return nodes; }
+
+private:
+    /// @brief Recursively builds the subtree over _primInfos_ in range [_start_, _end_)
+    void buildRecursive(std::vector<PrimInfo>& primInfos, const int32_t start, const int32_t end,
+                        const int32_t depth);
+
+    /// @brief Builds the hierarchy by sorting the primitives by the Morton codes of their
+    /// centroids and splitting the sorted ranges where the codes' bits change. With treelet
+    /// optimization the ranges that share the top LBVH_TREELET_BITS bits become treelets that
+    /// are built in parallel and joined by SAH. Returns the primitives in leaf order
+    std::vector<int32_t> buildLinear(const std::vector<BBox>& primBounds, ThreadPool* pool);
+
+    /// @brief Sorts _mortonPrims_ by their codes with LSD radix sort, in parallel on _pool_ if
+    /// given
+    static void radixSort(std::vector<MortonPrim>& mortonPrims, ThreadPool* pool);
+
+    /// @brief Appends to _lbvhNodes_ the subtree over the sorted primitives in range [_start_,
+    /// _end_) whose codes are split from bit _bitIndex_ down. Returns the bounds of the subtree
+    BBox emitLBVH(std::vector<Node>& lbvhNodes, const std::vector<MortonPrim>& mortonPrims,
+                  const std::vector<BBox>& primBounds, const int32_t start, const int32_t end,
+                  int32_t bitIndex) const;
+
+    /// @brief Recursively builds with SAH the levels above the treelets _treeletInfos_ in range
+    /// [_start_, _end_) and copies each treelet's nodes from _treeletNodes_ under its leaf
+    void buildUpperSAH(std::vector<PrimInfo>& treeletInfos, const int32_t start,
+                       const int32_t end, const int32_t depth,
+                       const std::vector<std::vector<Node>>& treeletNodes);
+
+    /// @brief Recomputes the bounds of node _nodeIdx_ from its primitives or children
+    void refitNode(const int32_t nodeIdx, const std::vector<BBox>& primBounds);
+
+    /// @brief Returns the index past the last node of the subtree rooted at _nodeIdx_. The
+    /// subtree's nodes are contiguous in depth-first order
+    int32_t subtreeEnd(int32_t nodeIdx) const;
+
+    /// @brief Finds the binned SAH split of the primitives in range [_start_, _end_) and
+    /// partitions them. Returns the partition point or -1 if the node should be leaf
+    int32_t partitionSAH(std::vector<PrimInfo>& primInfos, const int32_t start, const int32_t end,
+                         const BBox& nodeBounds, const BBox& centroidBounds,
+                         const int32_t axis) const;
+
+private:
+    std::vector<Node> nodes;  ///< Flattened nodes of the BVH
+    BVHSettings settings;     ///< Settings used to build the BVH
+};
+
+template <typename LeafVisitor>
+bool BVHTree::traverse(const Ray& ray, LeafVisitor&& visitLeaf) const {
+    if (nodes.empty())
+        return false;
+
+    const Vector3f invRayDir(1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z);
+    const int dirIsNeg[3] = {invRayDir.x < 0, invRayDir.y < 0, invRayDir.z < 0};
+    FixedStack<int32_t, BVH_MAX_DEPTH> nodesStack;
+    int32_t currNodeIdx = 0;
+    for (;;) {
+        // the box test is against [0, ray.tMax] so nodes behind the closest hit are skipped
+        const Node& currNode = nodes[currNodeIdx];
+        if (currNode.intersect(ray, invRayDir, dirIsNeg)) {
+            if (!currNode.isLeaf()) {
+                // visit first the child on the side the ray comes from along the split axis
+                if (dirIsNeg[currNode.splitAxis()]) {
+                    nodesStack.push(currNodeIdx + 1);
+                    currNodeIdx = currNode.secondChildIdx();
+                } else {
+                    nodesStack.push(currNode.secondChildIdx());
+                    currNodeIdx = currNodeIdx + 1;
+                }
+                continue;
+            }
+
+            if (visitLeaf(currNode))
+                return true;
+        }
+
+        if (nodesStack.empty())
+            break;
+        currNodeIdx = nodesStack.pop();
+    }
+
+    return false;
+}
+
+/// @brief Bounding volume hierarchy over the scene's triangles built with binned SAH. Unlike the
+/// Kd-tree every triangle is referenced by exactly one leaf
+class BVH : public Accelerator {
+    template <int32_t Width>
+    friend class WideBVH;  // collapses the binary nodes into multi-branch ones
+
+public:
+    /// @brief Builds the BVH over _sceneTriangles_, in parallel on _pool_ if given
+    BVH(std::vector<Triangle> sceneTriangles, const BVHSettings& bvhSettings,
+        ThreadPool* pool = nullptr);
+
+    bool intersect(const Ray& ray, Intersection& isectData) const override;
+
+    bool occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const override;
+
+    bool canRefit() const override { return true; }
+
+    /// @brief Refits the nodes to the moved triangles and rebuilds the hierarchy if its SAH cost
+    /// degraded beyond the rebuild threshold
+    bool refit(ThreadPool* pool) override;
+
+    void setTriangleIntersection(const TriangleIntersection method) override;
+
+private:
+    /// @brief Computes the bounds of the triangles in leaf order, in parallel on _pool_ if given
+    std::vector<BBox> computeTriangleBounds(ThreadPool* pool) const;
+
+    /// @brief Builds the hierarchy over the triangles with bounds _triangleBounds_, in parallel
+    /// on _pool_ if given, and reorders the triangles by the leaves
+    void build(const std::vector<BBox>& triangleBounds, ThreadPool* pool);
+
+    /// @brief Precomputes the intersection records for the selected method from the current
+    /// positions of the triangles, in parallel on _pool_ if given
+    void updateTriangleRecords(ThreadPool* pool);
+
+private:
+    BVHTree tree;                                 ///< Node hierarchy over the triangles
+    std::vector<Triangle> triangles;              ///< Triangles ordered by the leaves
+    std::vector<TriangleRecord> triangleRecords;  ///< Intersection records of the triangles
+    const BVHSettings settings;                   ///< Settings used to build the BVH
+    float builtSAHCost = 0.f;                     ///< SAH cost of the hierarchy when it was built
+};
+
+#endif  // !BVH_H
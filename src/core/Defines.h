@@ -19,10 +19,25 @@ static constexpr float REFLECTION_BIAS = 1e-3f;
 static constexpr float REFRACTION_BIAS = 1e-4f;
 static constexpr int MAX_RAY_DEPTH = 5;
 static constexpr size_t DEFAULT_BUCKET_SIZE = 16;
+static constexpr size_t ADAPTIVE_TILE_MIN_SIZE = 8;
+static constexpr size_t ADAPTIVE_TILE_MAX_SIZE = 64;
+static constexpr int64_t TASK_DEQUE_INITIAL_CAPACITY = 1024;
+static constexpr size_t TASK_INLINE_STORAGE_SIZE = 64;
 static constexpr float MAX_FLOAT = std::numeric_limits<float>::max();
 static constexpr float MIN_FLOAT = std::numeric_limits<float>::lowest();
 static constexpr size_t MAX_TRIANGLES_PER_NODE = 16;
+static constexpr int32_t TRIANGLE_PACKET_WIDTH = 8;
 static constexpr int32_t MAX_TREE_DEPTH = 30;
+static constexpr size_t MAILBOX_SIZE = 32;
+static constexpr uint32_t ACCEL_TREE_CACHE_VERSION = 1;
+static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+static constexpr size_t PARALLEL_BUILD_MIN_TRIANGLES = 4096;
+static constexpr int32_t BVH_MAX_DEPTH = 64;
+static constexpr int32_t MAX_BVH_BINS = 32;
+static constexpr int32_t MORTON_BITS_PER_AXIS = 10;
+static constexpr int32_t LBVH_TREELET_BITS = 12;
+static constexpr int32_t RADIX_SORT_BITS_PER_PASS = 6;
 static constexpr float Infinity = std::numeric_limits<float>::infinity();
 
 namespace SceneDefines {
@@ -32,6 +47,26 @@ namespace SceneDefines {
     inline const char* imageWidth = "width";
     inline const char* imageHeight = "height";
     inline const char* bucketSize = "bucket_size";
+    inline const char* tileOrder = "tile_order";
+    inline const char* adaptiveTiles = "adaptive_tiles";
+    inline const char* accelSettings = "accel_settings";
+    inline const char* accelStructure = "structure";
+    inline const char* twoLevel = "two_level";
+    inline const char* triangleIntersection = "triangle_intersection";
+    inline const char* splitMethod = "split_method";
+    inline const char* traversalCost = "traversal_cost";
+    inline const char* intersectionCost = "intersection_cost";
+    inline const char* emptyBonus = "empty_bonus";
+    inline const char* maxLeafTriangles = "max_leaf_triangles";
+    inline const char* maxTreeDepth = "max_depth";
+    inline const char* maxBadRefines = "max_bad_refines";
+    inline const char* perfectSplits = "perfect_splits";
+    inline const char* treeCache = "tree_cache";
+    inline const char* bvhBuilder = "bvh_builder";
+    inline const char* optimizeTreelets = "optimize_treelets";
+    inline const char* bvhBins = "bvh_bins";
+    inline const char* bvhMaxLeafTriangles = "bvh_max_leaf_triangles";
+    inline const char* bvhRebuildThreshold = "bvh_rebuild_threshold";
     inline const char* sceneLights = "lights";
     inline const char* lightIntensity = "intensity";
     inline const char* lightPosition = "position";
@@ -44,8 +79,14 @@ namespace SceneDefines {
     inline const char* cameraPos = "position";
     inline const char* cameraRotationM = "matrix";
     inline const char* sceneObjects = "objects";
+    inline const char* sceneMeshes = "meshes";
+    inline const char* sceneInstances = "instances";
+    inline const char* instanceMesh = "mesh";
+    inline const char* instanceTransform = "matrix";
+    inline const char* instanceTranslation = "position";
     inline const char* materialIdx = "material_index";
     inline const char* vertices = "vertices";
+    inline const char* objectVelocity = "velocity";
     inline const char* triangleIndices = "triangles";
 };  // namespace SceneDefines
 
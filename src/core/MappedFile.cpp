@@ -0,0 +1,46 @@
+#include "MappedFile.h"
+
+#ifdef CRT_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+MappedFile::MappedFile(const std::string& fileName) {
+#ifdef CRT_HAS_MMAP
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+        void* mapping = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            fileData = static_cast<const char*>(mapping);
+            fileSize = (size_t)fileStat.st_size;
+        }
+    }
+    close(fd);  // the mapping stays valid after the descriptor is closed
+#else
+    std::ifstream fileStream(fileName, std::ios::binary | std::ios::ate);
+    if (!fileStream.good())
+        return;
+
+    buffer.resize((size_t)fileStream.tellg());
+    fileStream.seekg(0);
+    if (!buffer.empty() && fileStream.read(buffer.data(), buffer.size())) {
+        fileData = buffer.data();
+        fileSize = buffer.size();
+    }
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef CRT_HAS_MMAP
+    if (fileData)
+        munmap(const_cast<char*>(fileData), fileSize);
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CRT_HAS_MMAP
+#endif
+
+/// @brief Read-only view of a whole file. The file is memory mapped where mmap is available,
+/// otherwise it is read into memory
+class MappedFile {
+public:
+    /// @brief Maps _fileName_, the view is invalid if the file can't be opened or is empty
+    explicit MappedFile(const std::string& fileName);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isValid() const { return fileData != nullptr; }
+
+    const char* data() const { return fileData; }
+
+    size_t size() const { return fileSize; }
+
+private:
+    const char* fileData = nullptr;  ///< Start of the file contents
+    size_t fileSize = 0;             ///< Size of the file in bytes
+#ifndef CRT_HAS_MMAP
+    std::vector<char> buffer;  ///< Contents of the file when it can't be mapped
+#endif
+};
+
+#endif  // !MAPPEDFILE_H
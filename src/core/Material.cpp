@@ -34,7 +34,7 @@ Color3f shadeDiffuse([[maybe_unused]] const Ray& ray, const Scene* scene, Inters
         const Ray shadowRay(isectData.pos + isectNormal * SHADOW_BIAS, lightDirN);
         shadowRay.tMax = lightDist;
         Color3f perLightColor;
-        if (!scene->intersectPrim(shadowRay)) {
+        if (!scene->occluded(shadowRay)) {
             perLightColor = Color3f(light.getIntensity() / lightArea * albedo * cosTheta);
         }
         hitColor += perLightColor;
@@ -10,29 +10,94 @@ int32_t Parser::parseSceneObjects(std::string_view inputFile,
         return EXIT_FAILURE;
     }
 
-    sceneObjects.reserve(objects.Size());
-    for (size_t i = 0; i < objects.Size(); ++i) {
-        const Value& vertices = objects[i].FindMember(SceneDefines::vertices)->value;
-        if (!vertices.IsArray()) {
-            std::cerr << "Parser failed to parse triangle vertices." << std::endl;
+    return parseMeshes(objects, sceneObjects);
+}
+
+int32_t Parser::parseSceneInstances(std::string_view inputFile,
+                                    std::vector<TriangleMesh>& sceneObjects,
+                                    std::vector<MeshInstance>& instances) {
+    Document doc = getJsonDocument(inputFile);
+
+    const auto instancesIt = doc.FindMember(SceneDefines::sceneInstances);
+    if (instancesIt == doc.MemberEnd())  // instancing is optional
+        return EXIT_SUCCESS;
+
+    const Value& instancesVal = instancesIt->value;
+    const auto meshesIt = doc.FindMember(SceneDefines::sceneMeshes);
+    if (!instancesVal.IsArray() || meshesIt == doc.MemberEnd() || !meshesIt->value.IsArray()) {
+        std::cerr << "Parser failed to parse scene instances." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // the objects are placed once as they are, the instanced meshes are stored after them and
+    // are shared by all of their instances
+    const int32_t numObjects = (int32_t)sceneObjects.size();
+    if (parseMeshes(meshesIt->value, sceneObjects) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    const int32_t numMeshes = (int32_t)sceneObjects.size() - numObjects;
+
+    // the materials are parsed later, each entry of their list is one material
+    const auto materialsIt = doc.FindMember(SceneDefines::materialsInfo);
+    const int32_t numMaterials =
+        (materialsIt != doc.MemberEnd() && materialsIt->value.IsArray())
+            ? (int32_t)materialsIt->value.Size()
+            : 0;
+
+    instances.resize(numObjects);
+    for (int32_t i = 0; i < numObjects; i++)
+        instances[i].meshIdx = i;
+
+    instances.reserve(numObjects + instancesVal.Size());
+    for (size_t i = 0; i < instancesVal.Size(); ++i) {
+        const Value& instanceVal = instancesVal[i];
+        if (!instanceVal.IsObject()) {
+            std::cerr << "Parser failed to parse scene instance." << std::endl;
             return EXIT_FAILURE;
         }
 
-        const Value& triangleIndices = objects[i].FindMember(SceneDefines::triangleIndices)->value;
-        if (!triangleIndices.IsArray()) {
-            std::cerr << "Parser failed to parse triangle indices." << std::endl;
+        MeshInstance& instance = instances.emplace_back();
+        const auto meshIdxIt = instanceVal.FindMember(SceneDefines::instanceMesh);
+        if (meshIdxIt == instanceVal.MemberEnd() || !meshIdxIt->value.IsInt() ||
+            meshIdxIt->value.GetInt() < 0 || meshIdxIt->value.GetInt() >= numMeshes) {
+            std::cerr << "Parser failed to parse instance mesh index." << std::endl;
             return EXIT_FAILURE;
         }
+        instance.meshIdx = numObjects + meshIdxIt->value.GetInt();
+
+        // the transform, translation and material override are optional
+        const auto transformIt = instanceVal.FindMember(SceneDefines::instanceTransform);
+        if (transformIt != instanceVal.MemberEnd()) {
+            if (!transformIt->value.IsArray() || transformIt->value.Size() != 9) {
+                std::cerr << "Parser failed to parse instance transform matrix." << std::endl;
+                return EXIT_FAILURE;
+            }
+            instance.transform = loadMatrix(transformIt->value.GetArray());
+            // a singular matrix has no inverse to bring the rays into the object space
+            if (fabs(determinant(instance.transform)) < EPSILON) {
+                std::cerr << "Parser failed to parse instance transform matrix." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
 
-        const Value& materialIdx = objects[i].FindMember(SceneDefines::materialIdx)->value;
-        if (!materialIdx.IsInt()) {
-            std::cerr << "Parser failed to parse material index." << std::endl;
-            return EXIT_FAILURE;
+        const auto translationIt = instanceVal.FindMember(SceneDefines::instanceTranslation);
+        if (translationIt != instanceVal.MemberEnd()) {
+            if (!translationIt->value.IsArray() || translationIt->value.Size() != 3) {
+                std::cerr << "Parser failed to parse instance position." << std::endl;
+                return EXIT_FAILURE;
+            }
+            instance.translation = loadVector(translationIt->value.GetArray());
         }
 
-        sceneObjects.emplace_back(loadVertices(vertices.GetArray()),
-                                  loadTriangleIndices(triangleIndices.GetArray()),
-                                  materialIdx.GetInt());
+        const auto materialIdxIt = instanceVal.FindMember(SceneDefines::materialIdx);
+        if (materialIdxIt != instanceVal.MemberEnd()) {
+            // -1 keeps the material of the mesh
+            if (!materialIdxIt->value.IsInt() || materialIdxIt->value.GetInt() < -1 ||
+                materialIdxIt->value.GetInt() >= numMaterials) {
+                std::cerr << "Parser failed to parse instance material index." << std::endl;
+                return EXIT_FAILURE;
+            }
+            instance.materialIdx = materialIdxIt->value.GetInt();
+        }
     }
 
     return EXIT_SUCCESS;
@@ -95,6 +160,198 @@ int32_t Parser::parseSceneSettings(std::string_view inputFile, SceneSettings& se
         settings.bucketSize = bucketSize.GetInt();
     }
 
+    const auto tileOrderIt = imageSettings.FindMember(SceneDefines::tileOrder);
+    if (tileOrderIt != imageSettings.MemberEnd()) {
+        const std::string_view tileOrder =
+            tileOrderIt->value.IsString() ? tileOrderIt->value.GetString() : "";
+        if (tileOrder == "row_major") {
+            settings.tileOrder = TileOrder::RowMajor;
+        } else if (tileOrder == "morton") {
+            settings.tileOrder = TileOrder::Morton;
+        } else if (tileOrder == "hilbert") {
+            settings.tileOrder = TileOrder::Hilbert;
+        } else if (tileOrder == "spiral") {
+            settings.tileOrder = TileOrder::Spiral;
+        } else {
+            std::cerr << "Parser failed to parse tile order." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto adaptiveTilesIt = imageSettings.FindMember(SceneDefines::adaptiveTiles);
+    if (adaptiveTilesIt != imageSettings.MemberEnd()) {
+        if (!adaptiveTilesIt->value.IsBool()) {
+            std::cerr << "Parser failed to parse adaptive tiles setting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        settings.adaptiveTiles = adaptiveTilesIt->value.GetBool();
+    }
+
+    return parseAccelSettings(inputFile, sceneSettings, settings);
+}
+
+int32_t Parser::parseAccelSettings(std::string_view inputFile, const Value& sceneSettings,
+                                   SceneSettings& settings) {
+    const auto accelSettingsIt = sceneSettings.FindMember(SceneDefines::accelSettings);
+    if (accelSettingsIt == sceneSettings.MemberEnd())  // the settings are optional
+        return EXIT_SUCCESS;
+
+    const Value& accelSettingsVal = accelSettingsIt->value;
+    if (!accelSettingsVal.IsObject()) {
+        std::cerr << "Parser failed to parse acceleration tree settings." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto structureIt = accelSettingsVal.FindMember(SceneDefines::accelStructure);
+    if (structureIt != accelSettingsVal.MemberEnd()) {
+        const std::string_view structure =
+            structureIt->value.IsString() ? structureIt->value.GetString() : "";
+        if (structure == "kd_tree") {
+            settings.accelStructure = AccelStructure::KdTree;
+        } else if (structure == "bvh") {
+            settings.accelStructure = AccelStructure::BVH;
+        } else if (structure == "bvh4") {
+            settings.accelStructure = AccelStructure::BVH4;
+        } else if (structure == "bvh8") {
+            settings.accelStructure = AccelStructure::BVH8;
+        } else {
+            std::cerr << "Parser failed to parse acceleration structure." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto twoLevelIt = accelSettingsVal.FindMember(SceneDefines::twoLevel);
+    if (twoLevelIt != accelSettingsVal.MemberEnd()) {
+        if (!twoLevelIt->value.IsBool()) {
+            std::cerr << "Parser failed to parse two level setting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        settings.twoLevel = twoLevelIt->value.GetBool();
+    }
+
+    const auto triangleIsectIt = accelSettingsVal.FindMember(SceneDefines::triangleIntersection);
+    if (triangleIsectIt != accelSettingsVal.MemberEnd()) {
+        const std::string_view triangleIsect =
+            triangleIsectIt->value.IsString() ? triangleIsectIt->value.GetString() : "";
+        if (triangleIsect == "moller_trumbore") {
+            settings.triangleIntersection = TriangleIntersection::MollerTrumbore;
+        } else if (triangleIsect == "watertight") {
+            settings.triangleIntersection = TriangleIntersection::Watertight;
+        } else {
+            std::cerr << "Parser failed to parse triangle intersection method." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    AccelTreeSettings& accelSettings = settings.accelSettings;
+    BVHSettings& bvhSettings = settings.bvhSettings;
+    const auto splitMethodIt = accelSettingsVal.FindMember(SceneDefines::splitMethod);
+    if (splitMethodIt != accelSettingsVal.MemberEnd()) {
+        const std::string_view splitMethod =
+            splitMethodIt->value.IsString() ? splitMethodIt->value.GetString() : "";
+        if (splitMethod == "middle") {
+            accelSettings.splitMethod = SplitMethod::Middle;
+        } else if (splitMethod == "sah") {
+            accelSettings.splitMethod = SplitMethod::SAH;
+        } else if (splitMethod == "event_sah") {
+            accelSettings.splitMethod = SplitMethod::EventSAH;
+        } else {
+            std::cerr << "Parser failed to parse split method." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto bvhBuilderIt = accelSettingsVal.FindMember(SceneDefines::bvhBuilder);
+    if (bvhBuilderIt != accelSettingsVal.MemberEnd()) {
+        const std::string_view bvhBuilder =
+            bvhBuilderIt->value.IsString() ? bvhBuilderIt->value.GetString() : "";
+        if (bvhBuilder == "sah") {
+            bvhSettings.builder = BVHBuilder::SAH;
+        } else if (bvhBuilder == "lbvh") {
+            bvhSettings.builder = BVHBuilder::LBVH;
+        } else {
+            std::cerr << "Parser failed to parse BVH builder." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto optimizeTreeletsIt = accelSettingsVal.FindMember(SceneDefines::optimizeTreelets);
+    if (optimizeTreeletsIt != accelSettingsVal.MemberEnd()) {
+        if (!optimizeTreeletsIt->value.IsBool()) {
+            std::cerr << "Parser failed to parse treelet optimization setting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        bvhSettings.optimizeTreelets = optimizeTreeletsIt->value.GetBool();
+    }
+
+    const auto perfectSplitsIt = accelSettingsVal.FindMember(SceneDefines::perfectSplits);
+    if (perfectSplitsIt != accelSettingsVal.MemberEnd()) {
+        if (!perfectSplitsIt->value.IsBool()) {
+            std::cerr << "Parser failed to parse perfect splits setting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        accelSettings.perfectSplits = perfectSplitsIt->value.GetBool();
+        if (accelSettings.perfectSplits && accelSettings.splitMethod != SplitMethod::EventSAH) {
+            std::cerr << "Parser failed to parse perfect splits setting, it requires the "
+                         "event_sah split method."
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // the cached tree is stored next to the scene file
+    const auto treeCacheIt = accelSettingsVal.FindMember(SceneDefines::treeCache);
+    if (treeCacheIt != accelSettingsVal.MemberEnd()) {
+        if (!treeCacheIt->value.IsBool()) {
+            std::cerr << "Parser failed to parse tree cache setting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (treeCacheIt->value.GetBool()) {
+            const std::string sceneFile(inputFile);
+            accelSettings.cacheFile = sceneFile.substr(0, sceneFile.rfind('.')) + ".kdcache";
+        }
+    }
+
+    // numeric settings keep their defaults when missing
+    const auto loadFloat = [&accelSettingsVal](const char* name, float& value) {
+        const auto it = accelSettingsVal.FindMember(name);
+        if (it == accelSettingsVal.MemberEnd())
+            return true;
+        if (!it->value.IsNumber())
+            return false;
+        value = it->value.GetFloat();
+        return true;
+    };
+    const auto loadInt = [&accelSettingsVal](const char* name, int32_t& value) {
+        const auto it = accelSettingsVal.FindMember(name);
+        if (it == accelSettingsVal.MemberEnd())
+            return true;
+        if (!it->value.IsInt())
+            return false;
+        value = it->value.GetInt();
+        return true;
+    };
+
+    if (!loadFloat(SceneDefines::traversalCost, accelSettings.traversalCost) ||
+        !loadFloat(SceneDefines::intersectionCost, accelSettings.isectCost) ||
+        !loadFloat(SceneDefines::emptyBonus, accelSettings.emptyBonus) ||
+        !loadInt(SceneDefines::maxLeafTriangles, accelSettings.maxLeafTriangles) ||
+        !loadInt(SceneDefines::maxTreeDepth, accelSettings.maxDepth) ||
+        !loadInt(SceneDefines::maxBadRefines, accelSettings.maxBadRefines) ||
+        !loadInt(SceneDefines::bvhBins, bvhSettings.numBins) ||
+        !loadInt(SceneDefines::bvhMaxLeafTriangles, bvhSettings.maxLeafTriangles) ||
+        !loadFloat(SceneDefines::bvhRebuildThreshold, bvhSettings.rebuildThreshold)) {
+        std::cerr << "Parser failed to parse acceleration tree settings." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (accelSettings.maxDepth > MAX_TREE_DEPTH) {
+        std::cout << "Acceleration tree depth is limited to " << MAX_TREE_DEPTH << std::endl;
+        accelSettings.maxDepth = MAX_TREE_DEPTH;
+    }
+    accelSettings.emptyBonus = std::clamp(accelSettings.emptyBonus, 0.f, 1.f);
+    bvhSettings.numBins = std::clamp(bvhSettings.numBins, 2, MAX_BVH_BINS);
+
     return EXIT_SUCCESS;
 }
 
@@ -176,6 +433,45 @@ int32_t Parser::parseMaterials(std::string_view inputFile, std::vector<Material>
     return EXIT_SUCCESS;
 }
 
+int32_t Parser::parseMeshes(const Value& meshes, std::vector<TriangleMesh>& sceneObjects) {
+    sceneObjects.reserve(sceneObjects.size() + meshes.Size());
+    for (size_t i = 0; i < meshes.Size(); ++i) {
+        const Value& vertices = meshes[i].FindMember(SceneDefines::vertices)->value;
+        if (!vertices.IsArray()) {
+            std::cerr << "Parser failed to parse triangle vertices." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const Value& triangleIndices = meshes[i].FindMember(SceneDefines::triangleIndices)->value;
+        if (!triangleIndices.IsArray()) {
+            std::cerr << "Parser failed to parse triangle indices." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const Value& materialIdx = meshes[i].FindMember(SceneDefines::materialIdx)->value;
+        if (!materialIdx.IsInt()) {
+            std::cerr << "Parser failed to parse material index." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        TriangleMesh& mesh = sceneObjects.emplace_back(
+            loadVertices(vertices.GetArray()), loadTriangleIndices(triangleIndices.GetArray()),
+            materialIdx.GetInt());
+
+        // the velocity is optional, meshes without one stay in place
+        const auto velocityIt = meshes[i].FindMember(SceneDefines::objectVelocity);
+        if (velocityIt != meshes[i].MemberEnd()) {
+            if (!velocityIt->value.IsArray() || velocityIt->value.Size() != 3) {
+                std::cerr << "Parser failed to parse object velocity." << std::endl;
+                return EXIT_FAILURE;
+            }
+            mesh.velocity = loadVector(velocityIt->value.GetArray());
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
 Document Parser::getJsonDocument(std::string_view inputFile) {
     std::ifstream inputFileStream(inputFile.data());
     if (!inputFileStream.good()) {
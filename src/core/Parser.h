@@ -1,11 +1,15 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <algorithm>
 #include <fstream>
 #include <string>
+#include "AccelSettings.h"
 #include "Camera.h"
 #include "Light.h"
 #include "Material.h"
+#include "TileOrder.h"
+#include "Triangle.h"
 #include "external_libs/rapidjson/document.h"
 #include "external_libs/rapidjson/istreamwrapper.h"
 
@@ -22,6 +26,13 @@ struct SceneSettings {
     Color3f backgrColor;
     SceneDimensions sceneDimensions;
     size_t bucketSize = 16;
+    TileOrder tileOrder = TileOrder::RowMajor;
+    bool adaptiveTiles = false;
+    AccelStructure accelStructure = AccelStructure::KdTree;
+    bool twoLevel = false;
+    TriangleIntersection triangleIntersection = TriangleIntersection::MollerTrumbore;
+    AccelTreeSettings accelSettings;
+    BVHSettings bvhSettings;
 };
 
 inline static Vector3f loadVector(const Value::ConstArray& valArr) {
@@ -69,12 +80,24 @@ public:
     static int32_t parseSceneObjects(std::string_view inputFile,
                                      std::vector<TriangleMesh>& sceneObjects);
 
+    /// @brief Retrieves the optional instanced meshes and their instances from given input json.
+    /// The meshes are appended to _sceneObjects_ and when instancing is used every object that
+    /// was parsed before also gets an instance that keeps it in place
+    static int32_t parseSceneInstances(std::string_view inputFile,
+                                       std::vector<TriangleMesh>& sceneObjects,
+                                       std::vector<MeshInstance>& instances);
+
     /// @brief Retrieves camera settings from given input json
     static int32_t parseCameraParameters(std::string_view inputFile, Camera& camera);
 
     /// @brief Retrieves scene settings from given input json
     static int32_t parseSceneSettings(std::string_view inputFile, SceneSettings& settings);
 
+    /// @brief Retrieves the optional acceleration structure type and build settings from given
+    /// scene settings. The tree cache file, if enabled, is placed next to _inputFile_
+    static int32_t parseAccelSettings(std::string_view inputFile, const Value& sceneSettings,
+                                      SceneSettings& settings);
+
     /// @brief Retrieves scene lights from given input json
     static int32_t parseSceneLights(std::string_view inputFile, std::vector<Light>& sceneLights);
 
@@ -82,6 +105,9 @@ public:
     static int32_t parseMaterials(std::string_view inputFile, std::vector<Material>& materials);
 
 private:
+    /// @brief Appends the triangle meshes described by the json array _meshes_ to _sceneObjects_
+    static int32_t parseMeshes(const Value& meshes, std::vector<TriangleMesh>& sceneObjects);
+
     /// @brief Retrieves json document from input stream
     static Document getJsonDocument(std::string_view inputFile);
 
@@ -2,6 +2,7 @@
 #define RENDERER_H
 
 #include "PPMImage.h"
+#include "TileOrder.h"
 #include "Utils.h"
 
 struct Scene;
@@ -11,6 +12,8 @@ struct Ray;
 struct RenderSettings {
     const unsigned numThreads = getHardwareThreads();
     size_t numPixelsPerThread = DEFAULT_BUCKET_SIZE;
+    TileOrder tileOrder = TileOrder::RowMajor;
+    bool adaptiveTiles = false;  ///< Fit the tiles to the render cost of the previous frame
 };
 
 /// @brief Trace a ray in the scene
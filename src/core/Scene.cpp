@@ -1,33 +1,117 @@
 #include "Scene.h"
+#include "AccelerationTree.h"
+#include "TwoLevelAccel.h"
+#include "WideBVH.h"
 
-Scene::Scene(const SceneParams& sceneParams)
+Scene::Scene(SceneParams&& sceneParams)
     : camera(std::move(sceneParams.camera)),
       sceneObjects(std::move(sceneParams.objects)),
+      sceneInstances(std::move(sceneParams.instances)),
       sceneLights(std::move(sceneParams.lights)),
       materials(std::move(sceneParams.materials)),
-      settings(std::move(sceneParams.settings)) {}
+      settings(std::move(sceneParams.settings)) {
+    // light passes through refractive objects, shadow rays continue past them
+    opaqueMaterials.resize(materials.size());
+    for (size_t i = 0; i < materials.size(); i++)
+        opaqueMaterials[i] = materials[i].type != MaterialType::REFRACTIVE;
+}
+
+/// @brief Builds the acceleration structure selected by _settings_ over _triangles_ that are
+/// bounded by _bounds_
+static std::unique_ptr<Accelerator> createAccelerator(std::vector<Triangle> triangles,
+                                                      const BBox& bounds,
+                                                      const SceneSettings& settings,
+                                                      ThreadPool* pool) {
+    switch (settings.accelStructure) {
+        case AccelStructure::KdTree:
+            return std::make_unique<AccelTree>(std::move(triangles), bounds,
+                                               settings.accelSettings, pool);
+        case AccelStructure::BVH:
+            return std::make_unique<BVH>(std::move(triangles), settings.bvhSettings, pool);
+        case AccelStructure::BVH4:
+            return std::make_unique<WideBVH<4>>(
+                BVH(std::move(triangles), settings.bvhSettings, pool));
+        case AccelStructure::BVH8:
+            return std::make_unique<WideBVH<8>>(
+                BVH(std::move(triangles), settings.bvhSettings, pool));
+        default:
+            Assert(false && "Received unsupported acceleration structure.");
+    }
+    return nullptr;
+}
+
+void Scene::createAccelTree(ThreadPool* pool) {
+    sceneBBox = BBox();
+    if (settings.twoLevel || !sceneInstances.empty()) {
+        // every mesh gets its own bottom-level structure, without instances in the scene each
+        // mesh is placed once as it is. The tree cache keeps a single tree so it is used only
+        // by the flattened scene
+        SceneSettings meshSettings(settings);
+        meshSettings.accelSettings.cacheFile.clear();
+        std::vector<std::unique_ptr<Accelerator>> meshAccels;
+        std::vector<MeshInstance> instances(sceneInstances);
+        for (size_t i = 0; i < sceneObjects.size(); i++) {
+            meshAccels.push_back(createAccelerator(sceneObjects[i].getTriangles(),
+                                                   sceneObjects[i].bounds, meshSettings, pool));
+            if (sceneInstances.empty())
+                instances.emplace_back().meshIdx = (int32_t)i;
+        }
+        auto twoLevelAccel = std::make_unique<TwoLevelAccel>(sceneObjects, std::move(meshAccels),
+                                                             instances, settings.bvhSettings);
+        sceneBBox = twoLevelAccel->getBounds();
+        accelerator = std::move(twoLevelAccel);
+        accelerator->setTriangleIntersection(settings.triangleIntersection);
+        return;
+    }
 
-void Scene::createAccelTree() {
     std::vector<Triangle> sceneTriangles;
     for (const auto& object : sceneObjects) {
         sceneTriangles.reserve(sceneTriangles.size() + object.vertIndices.size());
         object.retrieveTriangles(sceneTriangles);
         sceneBBox.unionWith(object.bounds);
     }
-    accelTree = std::make_unique<AccelTree>(std::move(sceneTriangles), sceneBBox);
+    accelerator = createAccelerator(std::move(sceneTriangles), sceneBBox, settings, pool);
+    accelerator->setTriangleIntersection(settings.triangleIntersection);
 }
 
-bool Scene::intersect(const Ray& ray, Intersection& isect) const {
-    if (accelTree) {
-        if (!sceneBBox.intersect(ray))
-            return false;
-        return accelTree->intersect(ray, sceneBBox, isect);
+void Scene::updateObjectVertices(const size_t objectIdx, std::vector<Point3f> vertPositions) {
+    Assert(objectIdx < sceneObjects.size());
+    sceneObjects[objectIdx].updateVertPositions(std::move(vertPositions));
+}
+
+void Scene::updateAccelTree(ThreadPool* pool) {
+    // the triangles reference the meshes, so the structures see the moved vertices already
+    if (!accelerator || !accelerator->refit(pool))
+        createAccelTree(pool);
+}
+
+bool Scene::animateObjects(ThreadPool* pool) {
+    bool moved = false;
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        const Vector3f velocity = sceneObjects[i].velocity;
+        if (velocity == Vector3f(0.f))
+            continue;
+
+        std::vector<Point3f> vertPositions = sceneObjects[i].vertPositions;
+        for (Point3f& vertPosition : vertPositions)
+            vertPosition += velocity;
+        updateObjectVertices(i, std::move(vertPositions));
+        moved = true;
     }
 
+    if (moved)
+        updateAccelTree(pool);
+    return moved;
+}
+
+bool Scene::intersect(const Ray& ray, Intersection& isect) const {
+    if (accelerator)
+        return accelerator->intersect(ray, isect);
+
     bool hasIntersect = false;
     Intersection closestPrim;
     for (const auto& object : sceneObjects) {
-        if (object.intersect(ray, isect)) {
+        if (object.intersect(ray, settings.triangleIntersection, isect)) {
             if (isect.t < closestPrim.t) {
                 closestPrim = isect;
             }
@@ -41,20 +125,14 @@ bool Scene::intersect(const Ray& ray, Intersection& isect) const {
     return hasIntersect;
 }
 
-bool Scene::intersectPrim(const Ray& ray) const {
-    Intersection closestPrim;
-    if (accelTree) {
-        if (!sceneBBox.intersect(ray))
-            return false;
-        return accelTree->intersectPrim(ray, sceneBBox, closestPrim) &&
-               materials[closestPrim.materialIdx].type != MaterialType::REFRACTIVE;
-    }
+bool Scene::occluded(const Ray& ray) const {
+    if (accelerator)
+        return accelerator->occluded(ray, opaqueMaterials);
 
     for (const auto& object : sceneObjects) {
-        if (object.intersectPrim(ray, closestPrim) &&
-            materials[closestPrim.materialIdx].type != MaterialType::REFRACTIVE) {
+        if (isOpaque(opaqueMaterials, object.materialIdx) &&
+            object.occluded(ray, settings.triangleIntersection))
             return true;
-        }
     }
 
     return false;
@@ -1,13 +1,15 @@
 #ifndef SCENE_H
 #define SCENE_H
 
-#include "AccelerationTree.h"
+#include <memory>
+#include "Accelerator.h"
 #include "Parser.h"
 
 /// @brief Stores parameters needed for initialization of scene object
 struct SceneParams {
     Camera camera;
     std::vector<TriangleMesh> objects;
+    std::vector<MeshInstance> instances;
     std::vector<Light> lights;
     std::vector<Material> materials;
     SceneSettings settings;
@@ -17,18 +19,32 @@ class Scene {
 public:
     Scene() = delete;
 
-    /// @brief Initialize scene data members from input json
-    Scene(const SceneParams& sceneParams);
+    /// @brief Initialize scene data members from input json, taking over the parsed geometry
+    Scene(SceneParams&& sceneParams);
 
-    /// @brief Constructs the acceleration tree
-    void createAccelTree();
+    /// @brief Constructs the acceleration structure selected by the scene settings, in parallel
+    /// on _pool_ if given. Scenes with instances always use the two-level structure and are
+    /// rendered correctly only once it is built
+    void createAccelTree(ThreadPool* pool = nullptr);
+
+    /// @brief Moves the vertices of object _objectIdx_ to _vertPositions_, keeping its triangles.
+    /// The acceleration structure is stale until updateAccelTree() is called
+    void updateObjectVertices(const size_t objectIdx, std::vector<Point3f> vertPositions);
+
+    /// @brief Updates the acceleration structure after objects moved their vertices. It is refit
+    /// where supported, otherwise it is built again
+    void updateAccelTree(ThreadPool* pool = nullptr);
+
+    /// @brief Moves the objects with a velocity by one frame and updates the acceleration
+    /// structure, in parallel on _pool_ if given. Returns false if all objects are static
+    bool animateObjects(ThreadPool* pool = nullptr);
 
     /// @brief Intersects ray with the scene and finds the closest intersection point if any
     bool intersect(const Ray& ray, Intersection& isect) const;
 
-    /// @brief Verifies if ray intersects with any non transparent scene object.
-    /// Returns true on first intersection, false if no ray-object intersection found
-    bool intersectPrim(const Ray& ray) const;
+    /// @brief Verifies if ray is blocked by any non transparent scene object. Returns true on
+    /// the first opaque triangle found, transparent (refractive) ones let the ray through
+    bool occluded(const Ray& ray) const;
 
     Camera& getCamera() { return camera; }
 
@@ -45,12 +61,14 @@ public:
     const std::vector<Material>& getMaterials() const { return materials; }
 
 private:
-    Camera camera;                                 ///< The scene's camera
-    const std::vector<TriangleMesh> sceneObjects;  ///< List of the scene's objects
-    const std::vector<Light> sceneLights;          ///< Lights in the scene
-    const std::vector<Material> materials;         ///< List of the scene's materials
-    const SceneSettings settings;                  ///< Global scene settings
-    std::unique_ptr<AccelTree> accelTree;          ///< The acceleration tree of the scene
+    Camera camera;                                   ///< The scene's camera
+    std::vector<TriangleMesh> sceneObjects;          ///< The scene's objects, never resized
+    const std::vector<MeshInstance> sceneInstances;  ///< Placements of the objects if instanced
+    const std::vector<Light> sceneLights;            ///< Lights in the scene
+    const std::vector<Material> materials;           ///< List of the scene's materials
+    OpaqueMaterials opaqueMaterials;                 ///< Materials that block shadow rays
+    const SceneSettings settings;                    ///< Global scene settings
+    std::unique_ptr<Accelerator> accelerator;        ///< The acceleration structure of the scene
     BBox sceneBBox;  ///< AABB of the entire scene. Computed only when acceleration tree is build
 };
 
@@ -62,6 +80,10 @@ inline static int32_t parseSceneParams(std::string_view inputFile, SceneParams&
     } else if (Parser::parseSceneObjects(inputFile, sceneParams.objects) != EXIT_SUCCESS) {
         std::cerr << "Scene parser failed." << std::endl;
         return EXIT_FAILURE;
+    } else if (Parser::parseSceneInstances(inputFile, sceneParams.objects,
+                                           sceneParams.instances) != EXIT_SUCCESS) {
+        std::cerr << "Scene parser failed." << std::endl;
+        return EXIT_FAILURE;
     } else if (Parser::parseSceneLights(inputFile, sceneParams.lights) != EXIT_SUCCESS) {
         std::cerr << "Scene parser failed." << std::endl;
         return EXIT_FAILURE;
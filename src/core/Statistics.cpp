@@ -21,7 +21,7 @@ void StatRegisterer::printStats() {
 void threadEntryPoint() { threadRunTimeTimer.start(); }
 
 void threadExitPoint(const std::thread::id& threadId) {
-    std::cout << std::fixed << std::setprecision(2) << "Thread " << threadId << " render time ["
+    std::cout << std::fixed << std::setprecision(2) << "Thread " << threadId << " work time ["
               << Timer::toMilliSec<float>(threadRunTimeTimer.getElapsedNanoSec()) << "ms]\n";
 }
 
@@ -0,0 +1,104 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "Defines.h"
+
+/// @brief Move-only callable with no arguments and no return value. Unlike std::function it keeps
+/// callables of up to TASK_INLINE_STORAGE_SIZE bytes in its own storage, such as the closure of
+/// a render tile, and allocates only the larger ones on the heap
+class Task {
+private:
+    /// @brief Type erased operations on the stored callable
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);  ///< Moves the callable and destroys the source
+        void (*destroy)(void* storage);
+    };
+
+    template <typename C>
+    static constexpr bool isStoredInline = sizeof(C) <= TASK_INLINE_STORAGE_SIZE &&
+                                           alignof(C) <= alignof(std::max_align_t) &&
+                                           std::is_nothrow_move_constructible_v<C>;
+
+    template <typename C>
+    static constexpr Ops inlineOps{
+        [](void* storage) { (*static_cast<C*>(storage))(); },
+        [](void* dst, void* src) {
+            new (dst) C(std::move(*static_cast<C*>(src)));
+            static_cast<C*>(src)->~C();
+        },
+        [](void* storage) { static_cast<C*>(storage)->~C(); }};
+
+    template <typename C>
+    static constexpr Ops heapOps{
+        [](void* storage) { (**static_cast<C**>(storage))(); },
+        [](void* dst, void* src) { *static_cast<C**>(dst) = *static_cast<C**>(src); },
+        [](void* storage) { delete *static_cast<C**>(storage); }};
+
+public:
+    Task() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& func) {
+        using Callable = std::decay_t<F>;
+        if constexpr (isStoredInline<Callable>) {
+            new (storage) Callable(std::forward<F>(func));
+            ops = &inlineOps<Callable>;
+        } else {
+            *reinterpret_cast<Callable**>(storage) = new Callable(std::forward<F>(func));
+            ops = &heapOps<Callable>;
+        }
+    }
+
+    Task(Task&& other) noexcept { moveFrom(other); }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    /// @brief Calls the stored callable
+    void operator()() {
+        Assert(ops && "Can't invoke an empty Task");
+        ops->invoke(storage);
+    }
+
+    /// @brief Checks if a callable is stored
+    explicit operator bool() const { return ops != nullptr; }
+
+private:
+    /// @brief Takes the callable of _other_ and leaves it empty
+    void moveFrom(Task& other) {
+        ops = other.ops;
+        if (ops) {
+            ops->move(storage, other.storage);
+            other.ops = nullptr;
+        }
+    }
+
+    /// @brief Destroys the stored callable
+    void reset() {
+        if (ops) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char storage[TASK_INLINE_STORAGE_SIZE];  ///< The callable
+    const Ops* ops = nullptr;  ///< Operations on the callable, nullptr if empty
+};
+
+#endif  // !TASK_H
@@ -4,19 +4,93 @@
 #include <algorithm>
 #include <atomic>
 #include <condition_variable>
-#include <queue>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include "Defines.h"
 #include "Statistics.h"
+#include "Task.h"
+#include "TileOrder.h"
+#include "WorkStealingDeque.h"
 
 /// @brief Helps to measure the active running time for each thread when work is assigned
 static thread_local bool threadBeginWork = false;
 
-/// @brief Simple thread pool class
+/// @brief Batch of tasks scheduled on a ThreadPool that can be waited for on its own, so several
+/// independent batches can be in flight on the same pool. Tasks of the group may schedule more
+/// tasks to it. Once wait() returned the group can be reused for another batch
+class TaskGroup {
+public:
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    /// @brief The scheduled tasks reference the group, so it outlives them
+    ~TaskGroup() { wait(); }
+
+    /// @brief Blocks the calling thread until all tasks scheduled to the group complete. Must not
+    /// be called from a task of the same pool
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCv.wait(lock, [this] { return pendingTasks == 0; });
+    }
+
+private:
+    friend class ThreadPool;
+
+    /// @brief Counts _count_ tasks scheduled to the group
+    void addTasks(const size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingTasks += count;
+    }
+
+    /// @brief Counts a completed task and wakes the waiters after the last one. The counter is
+    /// changed under the lock, so a waiter can't see it reach zero and destroy the group while
+    /// the last task still uses it
+    void completeTask() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pendingTasks == 0)
+            doneCv.notify_all();
+    }
+
+private:
+    std::mutex mutex{};                ///< Guards _pendingTasks_
+    std::condition_variable doneCv{};  ///< Notified when the last pending task completes
+    size_t pendingTasks = 0;           ///< Number of scheduled tasks that didn't complete yet
+};
+
+/// @brief Work-stealing thread pool. Each worker owns a deque of tasks, pushes and pops its own
+/// tasks at the bottom without locking and steals from the top of the other deques when its own
+/// is empty, starting at a random victim. Tasks submitted by threads outside the pool go to a
+/// separate submission deque the workers steal from
 class ThreadPool {
+private:
+    struct TaskBlock;
+
+    /// @brief Task in a deque of the pool with its bookkeeping
+    struct QueuedTask {
+        Task task;
+        TaskGroup* group = nullptr;  ///< Group the task belongs to, nullptr if none
+        TaskBlock* block = nullptr;  ///< Bulk allocation of the task, nullptr if allocated alone
+    };
+
+    /// @brief Tasks of one bulk submission in a single allocation, freed after the last of them
+    struct TaskBlock {
+        explicit TaskBlock(const size_t count)
+            : tasks(new QueuedTask[count]), pendingTasks(count) {}
+
+        std::unique_ptr<QueuedTask[]> tasks;  ///< The tasks
+        std::atomic_size_t pendingTasks;      ///< Number of tasks that didn't retire yet
+    };
+
 public:
-    /// @brief Set threads count and number of thread handles
-    explicit ThreadPool(const unsigned tCount) : workers(tCount), threadsCount(tCount) {}
+    /// @brief Set threads count and number of thread handles. Creates a deque per worker and the
+    /// submission deque
+    explicit ThreadPool(const unsigned tCount) : workers(tCount), threadsCount(tCount) {
+        for (unsigned i = 0; i <= tCount; i++)
+            taskDeques.push_back(std::make_unique<WorkStealingDeque<QueuedTask>>());
+    }
 
     ThreadPool() = delete;
     ThreadPool(const ThreadPool&) = delete;
@@ -26,113 +100,335 @@ public:
     void start() {
         Assert(!running && "Can't start ThreadPool if it's already running");
         running = true;
-        for (auto& worker : workers) {
-            worker = std::thread(&ThreadPool::workerBase, this);
+        for (unsigned i = 0; i < threadsCount; i++) {
+            workers[i] = std::thread(&ThreadPool::workerBase, this, i);
         }
     }
 
-    /// @brief Waits for all tasks to complete, then destroys all threads by joining them
+    /// @brief Destroys all threads by joining them, the tasks that didn't start are dropped
     void stop() {
         Assert(running && "Can't stop ThreadPool if it's not running");
         running = false;
-        workersCv.notify_all();
+        wakeWorkers();
         std::for_each(workers.begin(), workers.end(), std::mem_fn(&std::thread::join));
         workers.clear();
+        for (auto& taskDeque : taskDeques) {
+            while (QueuedTask* queuedTask = taskDeque->pop())
+                retireTask(queuedTask);
+        }
+        numQueuedTasks = 0;
+        numTasks = 0;
     }
 
-    /// @brief Wait for all tasks in the queue to complete
+    /// @brief Blocks until all scheduled tasks, of any group, complete and the workers that ran
+    /// them report their thread statistics
     void completeTasks() {
         shouldCompleteTasks = true;
-        for (;;) {
-            if (numTasks == 0 && activeWorkers == 0) {
-                shouldCompleteTasks = false;
-                break;
-            }
-            std::this_thread::yield();
-        }
+        // idle workers report their statistics as soon as they notice
+        wakeWorkers();
+        std::unique_lock<std::mutex> lock(completeMutex);
+        completeCv.wait(lock, [this] { return numTasks == 0 && activeWorkers == 0; });
+        shouldCompleteTasks = false;
     }
 
     /// @brief Divides 2D loop into [_tileWidth_ * _tileHeight_] 2D chunks of work.
-    /// Only the last chunks per dimension could be with different sizes
+    /// Only the last chunks per dimension could be with different sizes. All chunks are
+    /// allocated at once and enqueued in one locked operation, the workers take them in
+    /// _tileOrder_
     /// @tparam F The type of the function
     /// @param task The function to submit to the tasks queue
     /// @param loopWidth The length of the second dimension of the loop
     /// @param loopHeight The length of the first dimension of the loop
     /// @param tileWidth The width of the chunk for thread
     /// @param tileHeight The height of the chunk for thread
+    /// @param tileOrder The order in which the chunks are scheduled
     template <typename F>
     void parallelLoop2D(F&& task, const size_t loopWidth, const size_t loopHeight,
-                        const size_t tileWidth, const size_t tileHeight) {
-        using std::min;
-        for (size_t y0 = 0, y1 = tileHeight; y0 < y1;
-             y0 = y0 + tileHeight, y1 = min(y1 + tileHeight, loopHeight)) {
-            for (size_t x0 = 0, x1 = tileWidth; x0 < x1;
-                 x0 = x0 + tileWidth, x1 = min(x1 + tileWidth, loopWidth)) {
-                scheduleTask(std::forward<F>(task), x0, x1, y0, y1);
-            }
+                        const size_t tileWidth, const size_t tileHeight,
+                        const TileOrder tileOrder = TileOrder::RowMajor) {
+        scheduleTiles(nullptr, task,
+                      computeUniformTiles(loopWidth, loopHeight, tileWidth, tileHeight, tileOrder));
+    }
+
+    /// @brief Same as parallelLoop2D() above, but schedules the chunks to _group_
+    template <typename F>
+    void parallelLoop2D(TaskGroup& group, F&& task, const size_t loopWidth,
+                        const size_t loopHeight, const size_t tileWidth, const size_t tileHeight,
+                        const TileOrder tileOrder = TileOrder::RowMajor) {
+        scheduleTiles(&group, task,
+                      computeUniformTiles(loopWidth, loopHeight, tileWidth, tileHeight, tileOrder));
+    }
+
+    /// @brief Same as parallelLoop2D(), but runs _task_(x0, x1, y0, y1) for the given _tiles_ of
+    /// any sizes in their order, scheduled to _group_
+    template <typename F>
+    void parallelTiles(TaskGroup& group, F&& task, const std::vector<Tile>& tiles) {
+        scheduleTiles(&group, task, tiles);
+    }
+
+    /// @brief Runs _func_(i) for each i in [0, _count_) on the workers and waits for all calls to
+    /// complete. Unlike completeTasks() it waits only for its own tasks and does not report
+    /// thread statistics. Must be called from a thread that is not a worker of the pool
+    /// @tparam F The type of the function
+    /// @param count The number of calls
+    /// @param func The function to call with the index of each call
+    template <typename F>
+    void parallelFor(const size_t count, F&& func) {
+        TaskGroup group;
+        scheduleBlock(&group, count,
+                      [&func](const size_t i) { return Task([&func, i]() { func(i); }); });
+        group.wait();
+    }
+
+    /// @brief Sorts [_first_, _last_) by sorting one chunk per thread in parallel and then merging
+    /// the sorted chunks pairwise. Produces the same order as std::sort() for comparators that
+    /// impose a strict total order
+    template <typename RandomIt, typename Compare>
+    void parallelSort(RandomIt first, RandomIt last, Compare comp) {
+        const size_t size = (size_t)(last - first);
+        const size_t numChunks = std::min<size_t>(threadsCount, std::max<size_t>(size / 2, 1));
+        std::vector<size_t> chunkBounds(numChunks + 1);
+        for (size_t i = 0; i <= numChunks; i++) {
+            chunkBounds[i] = size * i / numChunks;
+        }
+
+        parallelFor(numChunks, [&](const size_t i) {
+            std::sort(first + chunkBounds[i], first + chunkBounds[i + 1], comp);
+        });
+
+        for (size_t width = 1; width < numChunks; width *= 2) {
+            const size_t numMerges = (numChunks + 2 * width - 1) / (2 * width);
+            parallelFor(numMerges, [&](const size_t i) {
+                const size_t begin = 2 * width * i;
+                const size_t middle = std::min(begin + width, numChunks);
+                const size_t end = std::min(begin + 2 * width, numChunks);
+                std::inplace_merge(first + chunkBounds[begin], first + chunkBounds[middle],
+                                   first + chunkBounds[end], comp);
+            });
         }
     }
 
-    /// @brief Submit a function with zero or more arguments, and no return value, into the tasks
-    /// queue. Notifies thread when the function is submitted
+    /// @brief Returns the number of worker threads
+    unsigned getThreadsCount() const { return threadsCount; }
+
+    /// @brief Submit a function with zero or more arguments, and no return value, to the pool.
+    /// A worker pushes it to its own deque, any other thread to the submission deque. Wakes a
+    /// sleeping worker if there is any
     /// @tparam F The type of the function
     /// @tparam ...Args The types of the arguments
-    /// @param task The function to submit to the tasks queue
+    /// @param task The function to submit to the pool
     /// @param ...args The arguments to pass to the function @task
     template <typename F, typename... Args>
     void scheduleTask(F&& task, Args&&... args) {
-        {
-            std::lock_guard<std::mutex> lock(tasksMutex);
-            tasksQueue.emplace(std::bind(std::forward<F>(task), std::forward<Args>(args)...));
-        }
-        ++numTasks;
-        workersCv.notify_one();
+        QueuedTask* queuedTask =
+            new QueuedTask{makeTask(std::forward<F>(task), std::forward<Args>(args)...)};
+        submitTasks(queuedTask, 1);
+    }
+
+    /// @brief Same as scheduleTask() above, but the task belongs to _group_ and group.wait()
+    /// returns only after it completes
+    template <typename F, typename... Args>
+    void scheduleTask(TaskGroup& group, F&& task, Args&&... args) {
+        group.addTasks(1);
+        QueuedTask* queuedTask =
+            new QueuedTask{makeTask(std::forward<F>(task), std::forward<Args>(args)...), &group};
+        submitTasks(queuedTask, 1);
     }
 
 private:
-    /// @brief A base function to be assigned to each thread. Waits until it is notified by
-    /// scheduleTask() that a task is available, and then retrieves the task from the queue and
-    /// executes it
-    void workerBase() {
-        for (;;) {
-            std::function<void()> task;
-            {
-                std::unique_lock<std::mutex> lock(tasksMutex);
-                if (shouldCompleteTasks && tasksQueue.empty()) {
-                    threadBeginWork = false;
-                    reportThreadStats(std::this_thread::get_id());
-                    --activeWorkers;
-                }
-                workersCv.wait(lock, [this] { return !tasksQueue.empty() || !running; });
-                if (!running)
-                    return;
-                task = std::move(tasksQueue.front());
-                tasksQueue.pop();
-                lock.unlock();
+    /// @brief A base function to be assigned to each thread. Runs the tasks of its own deque and
+    /// steals from the other deques when it is empty. Sleeps until scheduleTask() notifies it
+    /// when there are no tasks to take
+    void workerBase(const unsigned workerIdx) {
+        currentPool = this;
+        currentWorkerIdx = workerIdx;
+        uint32_t randomState = workerIdx * 0x9E3779B9u + 1;
+        while (running) {
+            if (QueuedTask* queuedTask = takeTask(workerIdx, randomState)) {
                 if (!threadBeginWork) {
                     ++activeWorkers;
                     threadEntryPoint();
                 }
                 threadBeginWork = true;
-                task();
-                --numTasks;
+                queuedTask->task();
+                if (queuedTask->group)
+                    queuedTask->group->completeTask();
+                retireTask(queuedTask);
+                if (--numTasks == 0)
+                    notifyCompletion();
+                continue;
+            }
+
+            // a task is in flight between the counter and a deque or another thread won it,
+            // look again
+            if (numQueuedTasks > 0) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (shouldCompleteTasks && threadBeginWork) {
+                threadBeginWork = false;
+                reportThreadStats(std::this_thread::get_id());
+                --activeWorkers;
+                notifyCompletion();
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            ++numSleepingWorkers;
+            workersCv.wait(lock, [this] {
+                return numQueuedTasks > 0 || !running || (shouldCompleteTasks && threadBeginWork);
+            });
+            --numSleepingWorkers;
+        }
+    }
+
+    /// @brief Pops a task from the deque of worker _workerIdx_, otherwise steals one from the
+    /// other deques visiting them from a random one. Returns nullptr if no task was taken
+    QueuedTask* takeTask(const unsigned workerIdx, uint32_t& randomState) {
+        QueuedTask* task = taskDeques[workerIdx]->pop();
+        if (!task) {
+            // xorshift32 picks the first victim
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 17;
+            randomState ^= randomState << 5;
+            const size_t numDeques = taskDeques.size();
+            const size_t firstVictim = randomState % numDeques;
+            for (size_t i = 0; i < numDeques && !task; i++) {
+                const size_t victim = (firstVictim + i) % numDeques;
+                if (victim != workerIdx)
+                    task = taskDeques[victim]->steal();
             }
         }
+
+        if (task)
+            --numQueuedTasks;
+        return task;
+    }
+
+    /// @brief Binds _args_ to _func_ in a task, with no heap allocation for the small closures
+    template <typename F, typename... Args>
+    static Task makeTask(F&& func, Args&&... args) {
+        if constexpr (sizeof...(Args) == 0) {
+            return Task(std::forward<F>(func));
+        } else {
+            return Task([func = std::forward<F>(func),
+                         ... args = std::forward<Args>(args)]() mutable {
+                std::invoke(func, args...);
+            });
+        }
+    }
+
+    /// @brief Schedules a task per tile of _tiles_ in their order to _group_, if not nullptr
+    template <typename F>
+    void scheduleTiles(TaskGroup* group, F& task, const std::vector<Tile>& tiles) {
+        scheduleBlock(group, tiles.size(), [&task, &tiles](const size_t i) {
+            const Tile& tile = tiles[i];
+            return makeTask(task, tile.x0, tile.x1, tile.y0, tile.y1);
+        });
+    }
+
+    /// @brief Schedules the _count_ tasks returned by _taskAt_(i) in their order to _group_, if
+    /// not nullptr, with a single allocation and a single submission for all of them
+    template <typename F>
+    void scheduleBlock(TaskGroup* group, const size_t count, F&& taskAt) {
+        if (count == 0)
+            return;
+
+        if (group)
+            group->addTasks(count);
+        TaskBlock* block = new TaskBlock(count);
+        for (size_t i = 0; i < count; i++) {
+            QueuedTask& queuedTask = block->tasks[i];
+            queuedTask.task = taskAt(i);
+            queuedTask.group = group;
+            queuedTask.block = block;
+        }
+        submitTasks(block->tasks.get(), count);
+    }
+
+    /// @brief Enqueues the _count_ consecutive _tasks_, taking the submission lock once for all
+    /// of them. Wakes a sleeping worker for a single task and all of them for more
+    void submitTasks(QueuedTask* tasks, const size_t count) {
+        numTasks += count;
+        // counted before the push, so a worker never sees a task that isn't counted yet
+        numQueuedTasks += count;
+        if (currentPool == this) {
+            for (size_t i = 0; i < count; i++)
+                taskDeques[currentWorkerIdx]->push(&tasks[i]);
+        } else {
+            // the submission deque has a single owner at a time
+            std::lock_guard<std::mutex> lock(submitMutex);
+            for (size_t i = 0; i < count; i++)
+                taskDeques[threadsCount]->push(&tasks[i]);
+        }
+
+        if (numSleepingWorkers > 0) {
+            // the lock orders the notification after the check of a worker going to sleep
+            { std::lock_guard<std::mutex> lock(sleepMutex); }
+            if (count > 1)
+                workersCv.notify_all();
+            else
+                workersCv.notify_one();
+        }
+    }
+
+    /// @brief Frees _queuedTask_, or its block after the last task of a bulk submission
+    static void retireTask(QueuedTask* queuedTask) {
+        if (TaskBlock* block = queuedTask->block) {
+            if (--block->pendingTasks == 0)
+                delete block;
+        } else {
+            delete queuedTask;
+        }
+    }
+
+    /// @brief Wakes all sleeping workers to check their wake up condition again
+    void wakeWorkers() {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        workersCv.notify_all();
+    }
+
+    /// @brief Wakes the thread waiting in completeTasks() to check its wake up condition again
+    void notifyCompletion() {
+        { std::lock_guard<std::mutex> lock(completeMutex); }
+        completeCv.notify_all();
     }
 
 private:
+    /// @brief Pool of the calling thread if it is a worker, nullptr otherwise
+    static inline thread_local const ThreadPool* currentPool = nullptr;
+
+    /// @brief Index of the calling worker in its pool
+    static inline thread_local unsigned currentWorkerIdx = 0;
+
     /// @brief Thread handles
     std::vector<std::thread> workers{};
 
-    /// @brief Mutex to synchronize access to tasks queue by different threads
-    mutable std::mutex tasksMutex{};
+    /// @brief Task deque per worker, followed by the submission deque of the other threads
+    std::vector<std::unique_ptr<WorkStealingDeque<QueuedTask>>> taskDeques{};
 
-    /// @brief Queue of tasks to be executed by the workers
-    std::queue<std::function<void()>> tasksQueue{};
+    /// @brief Serializes the pushes of threads outside the pool to the submission deque
+    std::mutex submitMutex{};
 
-    /// @brief Condition variable used to notify worker that a new task has become available
+    /// @brief Mutex that the sleeping workers wait on
+    std::mutex sleepMutex{};
+
+    /// @brief Condition variable used to wake sleeping workers when a task becomes available
     std::condition_variable workersCv{};
 
+    /// @brief Mutex that completeTasks() waits on
+    std::mutex completeMutex{};
+
+    /// @brief Condition variable used to wake completeTasks() when a task completes or a worker
+    /// reports its statistics
+    std::condition_variable completeCv{};
+
+    /// @brief Number of workers waiting on the condition variable
+    std::atomic_size_t numSleepingWorkers{};
+
+    /// @brief Number of scheduled tasks that no worker took yet
+    std::atomic_size_t numQueuedTasks{};
+
     /// @brief Atomic bool variable indicating if workers should quit
     std::atomic_bool running = false;
 
@@ -143,7 +439,7 @@ private:
     /// @brief The number of threads that have assigned work
     std::atomic_size_t activeWorkers{};
 
-    /// @brief Number of tasks in the queue
+    /// @brief Number of scheduled tasks that didn't complete yet
     std::atomic_size_t numTasks{};
 
     /// @brief Number of threads
@@ -0,0 +1,99 @@
+#include "TileCostMap.h"
+#include <algorithm>
+#include <cmath>
+
+TileCostMap::TileCostMap(const size_t _imageWidth, const size_t _imageHeight)
+    : imageWidth(_imageWidth),
+      imageHeight(_imageHeight),
+      numCellsX((_imageWidth + ADAPTIVE_TILE_MIN_SIZE - 1) / ADAPTIVE_TILE_MIN_SIZE),
+      numCellsY((_imageHeight + ADAPTIVE_TILE_MIN_SIZE - 1) / ADAPTIVE_TILE_MIN_SIZE),
+      cellCosts(numCellsX * numCellsY, 0.f) {}
+
+std::vector<Tile> TileCostMap::computeTiles(const size_t bucketSize,
+                                            const TileOrder tileOrder) const {
+    // summed-area table with a zero first row and column
+    const size_t stride = numCellsX + 1;
+    std::vector<double> costSums(stride * (numCellsY + 1), 0.0);
+    for (size_t y = 0; y < numCellsY; y++) {
+        for (size_t x = 0; x < numCellsX; x++) {
+            costSums[(x + 1) + (y + 1) * stride] = cellCosts[x + y * numCellsX] +
+                                                   costSums[x + (y + 1) * stride] +
+                                                   costSums[(x + 1) + y * stride] -
+                                                   costSums[x + y * stride];
+        }
+    }
+
+    const size_t tileSize =
+        std::max<size_t>(1, (bucketSize + ADAPTIVE_TILE_MIN_SIZE / 2) / ADAPTIVE_TILE_MIN_SIZE) *
+        ADAPTIVE_TILE_MIN_SIZE;
+    const double totalCost = costSums.back();
+    if (totalCost <= 0.0)  // nothing recorded yet
+        return computeUniformTiles(imageWidth, imageHeight, tileSize, tileSize, tileOrder);
+
+    const size_t numBucketTiles = ((imageWidth + bucketSize - 1) / bucketSize) *
+                                  ((imageHeight + bucketSize - 1) / bucketSize);
+    const double maxTileCost = totalCost / numBucketTiles;
+
+    constexpr size_t blockCells = ADAPTIVE_TILE_MAX_SIZE / ADAPTIVE_TILE_MIN_SIZE;
+    const uint32_t numBlocksX = (uint32_t)((numCellsX + blockCells - 1) / blockCells);
+    const uint32_t numBlocksY = (uint32_t)((numCellsY + blockCells - 1) / blockCells);
+    std::vector<CostedTile> costedTiles;
+    for (const uint32_t blockIdx : computeTileOrder(numBlocksX, numBlocksY, tileOrder)) {
+        subdivideBlock((blockIdx % numBlocksX) * blockCells, (blockIdx / numBlocksX) * blockCells,
+                       blockCells, maxTileCost, costSums, costedTiles);
+    }
+
+    std::stable_sort(costedTiles.begin(), costedTiles.end(),
+                     [](const CostedTile& lhs, const CostedTile& rhs) {
+                         return std::ilogb(lhs.cost) > std::ilogb(rhs.cost);
+                     });
+    std::vector<Tile> tiles(costedTiles.size());
+    std::transform(costedTiles.begin(), costedTiles.end(), tiles.begin(),
+                   [](const CostedTile& costedTile) { return costedTile.tile; });
+    return tiles;
+}
+
+void TileCostMap::recordTileCost(const Tile& tile, const int64_t costNanoSec) {
+    const float costPerPixel = costNanoSec / (float)((tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+    const size_t cellX0 = tile.x0 / ADAPTIVE_TILE_MIN_SIZE;
+    const size_t cellY0 = tile.y0 / ADAPTIVE_TILE_MIN_SIZE;
+    const size_t cellX1 = (tile.x1 + ADAPTIVE_TILE_MIN_SIZE - 1) / ADAPTIVE_TILE_MIN_SIZE;
+    const size_t cellY1 = (tile.y1 + ADAPTIVE_TILE_MIN_SIZE - 1) / ADAPTIVE_TILE_MIN_SIZE;
+    for (size_t y = cellY0; y < cellY1; y++) {
+        // the cells on the right and bottom edges of the image are smaller
+        const size_t cellHeight =
+            std::min((y + 1) * ADAPTIVE_TILE_MIN_SIZE, imageHeight) - y * ADAPTIVE_TILE_MIN_SIZE;
+        for (size_t x = cellX0; x < cellX1; x++) {
+            const size_t cellWidth =
+                std::min((x + 1) * ADAPTIVE_TILE_MIN_SIZE, imageWidth) - x * ADAPTIVE_TILE_MIN_SIZE;
+            cellCosts[x + y * numCellsX] = costPerPixel * (cellWidth * cellHeight);
+        }
+    }
+}
+
+void TileCostMap::subdivideBlock(const size_t cellX, const size_t cellY, const size_t numCells,
+                                 const double maxTileCost, const std::vector<double>& costSums,
+                                 std::vector<CostedTile>& tiles) const {
+    if (cellX >= numCellsX || cellY >= numCellsY)  // the block is out of the image
+        return;
+
+    const size_t cellX1 = std::min(cellX + numCells, numCellsX);
+    const size_t cellY1 = std::min(cellY + numCells, numCellsY);
+    const size_t stride = numCellsX + 1;
+    const double cost = costSums[cellX1 + cellY1 * stride] - costSums[cellX + cellY1 * stride] -
+                        costSums[cellX1 + cellY * stride] + costSums[cellX + cellY * stride];
+    if (cost > maxTileCost && numCells > 1) {
+        const size_t half = numCells / 2;
+        subdivideBlock(cellX, cellY, half, maxTileCost, costSums, tiles);
+        subdivideBlock(cellX + half, cellY, half, maxTileCost, costSums, tiles);
+        subdivideBlock(cellX, cellY + half, half, maxTileCost, costSums, tiles);
+        subdivideBlock(cellX + half, cellY + half, half, maxTileCost, costSums, tiles);
+        return;
+    }
+
+    const Tile tile{cellX * ADAPTIVE_TILE_MIN_SIZE,
+                    std::min(cellX1 * ADAPTIVE_TILE_MIN_SIZE, imageWidth),
+                    cellY * ADAPTIVE_TILE_MIN_SIZE,
+                    std::min(cellY1 * ADAPTIVE_TILE_MIN_SIZE, imageHeight)};
+    tiles.push_back({tile, cost});
+}
@@ -0,0 +1,54 @@
+#ifndef TILECOSTMAP_H
+#define TILECOSTMAP_H
+
+#include <cstddef>
+#include <vector>
+#include "Defines.h"
+#include "TileOrder.h"
+
+/// @brief Render cost of an image per [ADAPTIVE_TILE_MIN_SIZE * ADAPTIVE_TILE_MIN_SIZE] cell,
+/// measured on the tiles of the last frame. The tiles of the next frame are fitted to the costs,
+/// so the expensive regions are subdivided and the cheap ones merged into tiles of similar cost.
+/// Then no straggling tile keeps a single worker busy at the end of the frame
+class TileCostMap {
+public:
+    TileCostMap() = delete;
+
+    TileCostMap(const size_t _imageWidth, const size_t _imageHeight);
+
+    /// @brief Computes the tiles of the next frame. The tiles are aligned to the cells. Before any
+    /// cost is recorded they are uniform with the side of _bucketSize_ rounded to the cells and
+    /// listed in _tileOrder_. Afterwards the cells are grouped in quadtrees of
+    /// ADAPTIVE_TILE_MAX_SIZE blocks, split while they cost more than the average
+    /// [_bucketSize_ * _bucketSize_] tile of the last frame. Those are listed from the most
+    /// expensive, so no costly tile starts last, by powers of two of their cost to keep
+    /// _tileOrder_ among the tiles of similar cost
+    std::vector<Tile> computeTiles(const size_t bucketSize, const TileOrder tileOrder) const;
+
+    /// @brief Spreads the time _costNanoSec_ spent on _tile_, one of the tiles last returned by
+    /// computeTiles(), evenly over its pixels. Safe to call concurrently for different tiles
+    void recordTileCost(const Tile& tile, const int64_t costNanoSec);
+
+private:
+    /// @brief Tile with its cost in the last frame
+    struct CostedTile {
+        Tile tile;
+        double cost;
+    };
+
+    /// @brief Adds the block at cell (_cellX_, _cellY_) with side _numCells_ to _tiles_, or its
+    /// quadrants in Z-order if it costs more than _maxTileCost_. _costSums_ is the summed-area
+    /// table of the cell costs
+    void subdivideBlock(const size_t cellX, const size_t cellY, const size_t numCells,
+                        const double maxTileCost, const std::vector<double>& costSums,
+                        std::vector<CostedTile>& tiles) const;
+
+private:
+    size_t imageWidth;             ///< Width of the image in pixels
+    size_t imageHeight;            ///< Height of the image in pixels
+    size_t numCellsX;              ///< Number of cells per row
+    size_t numCellsY;              ///< Number of cells per column
+    std::vector<float> cellCosts;  ///< Nanoseconds spent on each cell in the last frame
+};
+
+#endif  // !TILECOSTMAP_H
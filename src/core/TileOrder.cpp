@@ -0,0 +1,111 @@
+#include "TileOrder.h"
+#include <algorithm>
+
+/// @brief Smallest power of two not less than _x_
+inline static uint32_t roundUpPow2(const uint32_t x) {
+    uint32_t pow2 = 1;
+    while (pow2 < x)
+        pow2 <<= 1;
+    return pow2;
+}
+
+/// @brief Extracts the even bits of _x_ to the lower half
+inline static uint32_t compactBits2(uint32_t x) {
+    x &= 0x55555555;
+    x = (x ^ (x >> 1)) & 0x33333333;
+    x = (x ^ (x >> 2)) & 0x0F0F0F0F;
+    x = (x ^ (x >> 4)) & 0x00FF00FF;
+    x = (x ^ (x >> 8)) & 0x0000FFFF;
+    return x;
+}
+
+/// @brief Converts distance _d_ along the Hilbert curve filling [_side_ * _side_] grid to cell
+/// coordinates
+inline static void hilbertToCell(const uint32_t side, uint32_t d, uint32_t& x, uint32_t& y) {
+    x = y = 0;
+    for (uint32_t s = 1; s < side; s <<= 1) {
+        const uint32_t rx = 1 & (d / 2);
+        const uint32_t ry = 1 & (d ^ rx);
+        // rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+std::vector<uint32_t> computeTileOrder(const uint32_t numTilesX, const uint32_t numTilesY,
+                                       const TileOrder tileOrder) {
+    const uint32_t numTiles = numTilesX * numTilesY;
+    std::vector<uint32_t> order;
+    order.reserve(numTiles);
+    const auto addTile = [&](const int64_t x, const int64_t y) {
+        if (x >= 0 && x < numTilesX && y >= 0 && y < numTilesY)
+            order.push_back((uint32_t)(x + y * numTilesX));
+    };
+
+    switch (tileOrder) {
+        case TileOrder::RowMajor: {
+            for (uint32_t i = 0; i < numTiles; i++)
+                order.push_back(i);
+            break;
+        }
+        case TileOrder::Morton: {
+            const uint32_t side = roundUpPow2(std::max(numTilesX, numTilesY));
+            for (uint32_t d = 0; d < side * side; d++)
+                addTile(compactBits2(d), compactBits2(d >> 1));
+            break;
+        }
+        case TileOrder::Hilbert: {
+            const uint32_t side = roundUpPow2(std::max(numTilesX, numTilesY));
+            for (uint32_t d = 0; d < side * side; d++) {
+                uint32_t x, y;
+                hilbertToCell(side, d, x, y);
+                addTile(x, y);
+            }
+            break;
+        }
+        case TileOrder::Spiral: {
+            // legs of lengths 1, 1, 2, 2, 3, 3... turning clockwise
+            const int64_t dirX[4] = {1, 0, -1, 0};
+            const int64_t dirY[4] = {0, 1, 0, -1};
+            int64_t x = numTilesX / 2;
+            int64_t y = numTilesY / 2;
+            addTile(x, y);
+            for (int64_t legLength = 1, dir = 0; order.size() < numTiles; dir = (dir + 1) % 4) {
+                for (int64_t step = 0; step < legLength; step++) {
+                    x += dirX[dir];
+                    y += dirY[dir];
+                    addTile(x, y);
+                }
+                if (dir % 2 == 1)
+                    legLength++;
+            }
+            break;
+        }
+    }
+
+    return order;
+}
+
+std::vector<Tile> computeUniformTiles(const size_t loopWidth, const size_t loopHeight,
+                                      const size_t tileWidth, const size_t tileHeight,
+                                      const TileOrder tileOrder) {
+    const uint32_t numTilesX = (uint32_t)((loopWidth + tileWidth - 1) / tileWidth);
+    const uint32_t numTilesY = (uint32_t)((loopHeight + tileHeight - 1) / tileHeight);
+    std::vector<Tile> tiles;
+    tiles.reserve(numTilesX * numTilesY);
+    for (const uint32_t tileIdx : computeTileOrder(numTilesX, numTilesY, tileOrder)) {
+        const size_t x0 = (tileIdx % numTilesX) * tileWidth;
+        const size_t y0 = (tileIdx / numTilesX) * tileHeight;
+        tiles.push_back({x0, std::min(x0 + tileWidth, loopWidth), y0,
+                         std::min(y0 + tileHeight, loopHeight)});
+    }
+    return tiles;
+}
@@ -0,0 +1,36 @@
+#ifndef TILEORDER_H
+#define TILEORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Order in which the tiles of a 2D loop are scheduled. The space-filling curves keep the
+/// consecutive tiles adjacent, so the workers that run them at the same time trace neighbouring
+/// rays and share the accelerator nodes they fetch
+enum class TileOrder {
+    RowMajor,  ///< Row after row from the top left tile
+    Morton,    ///< Z-order curve
+    Hilbert,   ///< Hilbert curve, consecutive tiles always share an edge
+    Spiral     ///< Square spiral starting at the center tile
+};
+
+/// @brief Half-open 2D range [x0, x1) * [y0, y1) of a 2D loop
+struct Tile {
+    size_t x0, x1;  ///< Range of the second dimension
+    size_t y0, y1;  ///< Range of the first dimension
+};
+
+/// @brief Computes the indices (x + y * _numTilesX_) of a [_numTilesX_ * _numTilesY_] tile grid in
+/// the order given by _tileOrder_. The curves are laid over the smallest enclosing square grid
+/// and the tiles outside the loop are skipped
+std::vector<uint32_t> computeTileOrder(const uint32_t numTilesX, const uint32_t numTilesY,
+                                       const TileOrder tileOrder);
+
+/// @brief Divides [_loopWidth_ * _loopHeight_] 2D loop into [_tileWidth_ * _tileHeight_] tiles
+/// listed in _tileOrder_. Only the last tiles per dimension could be with different sizes
+std::vector<Tile> computeUniformTiles(const size_t loopWidth, const size_t loopHeight,
+                                      const size_t tileWidth, const size_t tileHeight,
+                                      const TileOrder tileOrder);
+
+#endif  // !TILEORDER_H
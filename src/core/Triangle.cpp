@@ -6,11 +6,23 @@
 STAT(NUM_TRIANGLE_ISECT_TESTS, numTriIsectTests, triIsectTestRegisterer);
 STAT(NUM_TRIANGLE_ISECTS, numTriIsects, isectRegisterer);
 
-TriangleMesh::TriangleMesh(const std::vector<Point3f>& _vertPositions,
-                           const std::vector<TriangleIndices>& _vertIndices,
-                           const int32_t _materialIdx)
-    : vertPositions(_vertPositions), vertIndices(_vertIndices), materialIdx(_materialIdx) {
-    vertNormals.resize(vertPositions.size());
+TriangleMesh::TriangleMesh(std::vector<Point3f> _vertPositions,
+                           std::vector<TriangleIndices> _vertIndices, const int32_t _materialIdx)
+    : vertPositions(std::move(_vertPositions)),
+      vertIndices(std::move(_vertIndices)),
+      materialIdx(_materialIdx) {
+    computeNormalsAndBounds();
+}
+
+void TriangleMesh::updateVertPositions(std::vector<Point3f> _vertPositions) {
+    Assert(_vertPositions.size() == vertPositions.size());
+    vertPositions = std::move(_vertPositions);
+    computeNormalsAndBounds();
+}
+
+void TriangleMesh::computeNormalsAndBounds() {
+    vertNormals.assign(vertPositions.size(), Normal3f());
+    bounds = BBox();
     for (size_t i = 0; i < vertIndices.size(); i++) {
         const Vector3f& A = vertPositions[vertIndices[i][0]];
         const Vector3f& B = vertPositions[vertIndices[i][1]];
@@ -53,31 +65,42 @@ void TriangleMesh::retrieveTriangles(std::vector<Triangle>& dest) const {
                   });
 }
 
-bool TriangleMesh::intersect(const Ray& ray, Intersection& isect) const {
+bool TriangleMesh::intersect(const Ray& ray, const TriangleIntersection method,
+                             Intersection& isect) const {
     // early return if ray does not intersect with the object bounds
     if (!bounds.intersect(ray))
         return false;
 
-    bool hasIntersect = false;
+    // only the closest hit's attributes are computed
+    const TriangleIntersector intersector(ray, method);
+    TriangleHit closestHit;
     for (size_t i = 0; i < vertIndices.size(); i++) {
-        const Triangle triangle(vertIndices[i], this);
-        if (triangle.intersectMT(ray, isect)) {
-            if (isect.t < ray.tMax) {
-                ray.tMax = isect.t;
-            }
-            hasIntersect = true;
+        const TriangleRecord record(Triangle(vertIndices[i], this), method);
+        float t, u, v;
+        if (intersector.intersect(record, t, u, v)) {
+            closestHit = {t, u, v, (int32_t)i};
+            ray.tMax = t;
         }
     }
 
-    return hasIntersect;
+    if (closestHit.primIdx < 0)
+        return false;
+
+    const Triangle triangle(vertIndices[closestHit.primIdx], this);
+    triangle.computeIntersection(ray, closestHit.t, closestHit.u, closestHit.v, isect);
+    return true;
 }
 
-bool TriangleMesh::intersectPrim(const Ray& ray, Intersection& isect) const {
+bool TriangleMesh::occluded(const Ray& ray, const TriangleIntersection method) const {
+    if (!bounds.intersect(ray))
+        return false;
+
+    const TriangleIntersector intersector(ray, method);
     for (size_t i = 0; i < vertIndices.size(); i++) {
-        const Triangle triangle(vertIndices[i], this);
-        if (triangle.intersectMT(ray, isect)) {
+        const TriangleRecord record(Triangle(vertIndices[i], this), method);
+        float t, u, v;
+        if (intersector.intersect(record, t, u, v))
             return true;
-        }
     }
     return false;
 }
@@ -157,16 +180,41 @@ bool Triangle::intersect(const Ray& ray, Intersection& isect) const {
     return true;
 }
 
-bool Triangle::intersectMT(const Ray& ray, Intersection& isect) const {
-    ++numTriIsectTests;
-    // takes out the triangle's vertices
-    const Vector3f& A = mesh->vertPositions[indices[0]];
-    const Vector3f& B = mesh->vertPositions[indices[1]];
-    const Vector3f& C = mesh->vertPositions[indices[2]];
+TriangleRecord::TriangleRecord(const Triangle& triangle, const TriangleIntersection method) {
+    const TriangleMesh* mesh = triangle.mesh;
+    A = mesh->vertPositions[triangle.indices[0]];
+    P1 = mesh->vertPositions[triangle.indices[1]];
+    P2 = mesh->vertPositions[triangle.indices[2]];
+    if (method == TriangleIntersection::MollerTrumbore) {
+        P1 -= A;
+        P2 -= A;
+    }
+}
 
-    const Vector3f AB = B - A;
-    const Vector3f AC = C - A;
+TriangleIntersector::TriangleIntersector(const Ray& _ray, const TriangleIntersection _method)
+    : ray(_ray), method(_method) {
+    if (method != TriangleIntersection::Watertight)
+        return;
+
+    // the dominant axis of the direction becomes the z axis of the sheared space, x and y are
+    // swapped for negative direction to keep the winding of the triangles
+    const Vector3f absDir(fabs(ray.dir.x), fabs(ray.dir.y), fabs(ray.dir.z));
+    shear.kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2) : (absDir.y > absDir.z ? 1 : 2);
+    shear.kx = (shear.kz + 1) % 3;
+    shear.ky = (shear.kx + 1) % 3;
+    if (ray.dir[shear.kz] < 0)
+        std::swap(shear.kx, shear.ky);
+
+    shear.Sx = ray.dir[shear.kx] / ray.dir[shear.kz];
+    shear.Sy = ray.dir[shear.ky] / ray.dir[shear.kz];
+    shear.Sz = 1.f / ray.dir[shear.kz];
+}
 
+bool TriangleIntersector::intersectMT(const TriangleRecord& record, float& t, float& u,
+                                      float& v) const {
+    ++numTriIsectTests;
+    const Vector3f& AB = record.P1;
+    const Vector3f& AC = record.P2;
     const Vector3f pVec = cross(ray.dir, AC);
     const float det = dot(AB, pVec);
 
@@ -177,44 +225,99 @@ bool Triangle::intersectMT(const Ray& ray, Intersection& isect) const {
     const float invDet = 1 / det;
 
     // computes _u_ parameter and test if it's in bounds
-    const Vector3f tVec = ray.origin - A;
-    const float u = dot(tVec, pVec) * invDet;
+    const Vector3f tVec = ray.origin - record.A;
+    u = dot(tVec, pVec) * invDet;
     if (u < 0 || u > 1)
         return false;
 
     // computes _v_ parameter and test if it's in bounds
     const Vector3f qVec = cross(tVec, AB);
-    const float v = dot(ray.dir, qVec) * invDet;
+    v = dot(ray.dir, qVec) * invDet;
     if (v < 0 || u + v > 1)
         return false;
 
     // computes _t_ parameter and test that the triangle is not behind the
     // ray origin and the triangle is ahead of the closest found so far
-    const float t = dot(AC, qVec) * invDet;
+    t = dot(AC, qVec) * invDet;
     if (t < 0 || t > ray.tMax)
         return false;
 
-    // gets intersection point
-    const Vector3f P = ray.at(t);
+    ++numTriIsects;
 
-    // computes face normal
-    Vector3f N = cross(AB, AC);
+    return true;
+}
 
-    // takes out the triangle's vertex normals
+bool TriangleIntersector::intersectWatertight(const TriangleRecord& record, float& t, float& u,
+                                              float& v) const {
+    ++numTriIsectTests;
+    const int32_t kx = shear.kx;
+    const int32_t ky = shear.ky;
+    const int32_t kz = shear.kz;
+
+    // moves the vertices to the ray origin
+    const Vector3f A = record.A - ray.origin;
+    const Vector3f B = record.P1 - ray.origin;
+    const Vector3f C = record.P2 - ray.origin;
+
+    // shears the vertices so the ray runs along the z axis
+    const float Ax = A[kx] - shear.Sx * A[kz];
+    const float Ay = A[ky] - shear.Sy * A[kz];
+    const float Bx = B[kx] - shear.Sx * B[kz];
+    const float By = B[ky] - shear.Sy * B[kz];
+    const float Cx = C[kx] - shear.Sx * C[kz];
+    const float Cy = C[ky] - shear.Sy * C[kz];
+
+    // scaled barycentric coordinates from the edge functions
+    float U = Cx * By - Cy * Bx;
+    float V = Ax * Cy - Ay * Cx;
+    float W = Bx * Ay - By * Ax;
+    if (U == 0.f || V == 0.f || W == 0.f) {
+        U = (float)((double)Cx * By - (double)Cy * Bx);
+        V = (float)((double)Ax * Cy - (double)Ay * Cx);
+        W = (float)((double)Bx * Ay - (double)By * Ax);
+    }
+
+    // the ray misses if the edge functions have different signs
+    if ((U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0))
+        return false;
+
+    const float det = U + V + W;
+    if (det == 0.f)
+        return false;
+
+    // interpolates the sheared distances of the vertices
+    const float Az = shear.Sz * A[kz];
+    const float Bz = shear.Sz * B[kz];
+    const float Cz = shear.Sz * C[kz];
+    const float invDet = 1 / det;
+    t = (U * Az + V * Bz + W * Cz) * invDet;
+    if (t < 0 || t > ray.tMax)
+        return false;
+
+    u = V * invDet;
+    v = W * invDet;
+
+    ++numTriIsects;
+
+    return true;
+}
+
+void Triangle::computeIntersection(const Ray& ray, const float t, const float u, const float v,
+                                   Intersection& isect) const {
+    // takes out the triangle's vertices and vertex normals
+    const Vector3f& A = mesh->vertPositions[indices[0]];
+    const Vector3f& B = mesh->vertPositions[indices[1]];
+    const Vector3f& C = mesh->vertPositions[indices[2]];
     const Normal3f& v0N = mesh->vertNormals[indices[0]];
     const Normal3f& v1N = mesh->vertNormals[indices[1]];
     const Normal3f& v2N = mesh->vertNormals[indices[2]];
 
     // records intersection data
-    isect.pos = P;
-    isect.faceNormal = N.normalize();
+    isect.pos = ray.at(t);
+    isect.faceNormal = cross(B - A, C - A).normalize();
     isect.t = t;
     isect.u = u;
     isect.v = v;
-    isect.smoothNormal = v1N * isect.u + v2N * isect.v + v0N * (1 - isect.u - isect.v);
+    isect.smoothNormal = v1N * u + v2N * v + v0N * (1 - u - v);
     isect.materialIdx = mesh->materialIdx;
-
-    ++numTriIsects;
-
-    return true;
 }
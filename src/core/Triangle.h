@@ -20,7 +20,17 @@ struct Intersection {
     int32_t materialIdx;    ///< Material index of the intersection
 };
 
+/// @brief Closest hit found so far by a query. Keeps only what the intersection test computes,
+/// the hit attributes are computed once for the final hit
+struct TriangleHit {
+    float t = MAX_FLOAT;   ///< Distance from the origin of the ray to the hit
+    float u = 0.f;         ///< Barycentric coordinate of the second vertex
+    float v = 0.f;         ///< Barycentric coordinate of the third vertex
+    int32_t primIdx = -1;  ///< Index of the hit triangle in the queried structure, -1 if none
+};
+
 struct TriangleMesh;
+struct TriangleRecord;
 
 struct Triangle {
     const int* indices;        ///< Indices of the triangle's vertices in the mesh
@@ -34,8 +44,75 @@ struct Triangle {
     /// @brief Verifies if ray intersect with the triangle
     bool intersect(const Ray& ray, Intersection& isect) const;
 
-    /// @brief Verifies if ray intersect with the triangle using Moller-Trumbor method
-    bool intersectMT(const Ray& ray, Intersection& isect) const;
+    /// @brief Records in _isect_ the hit of _ray_ at distance _t_ with barycentric coordinates
+    /// _u_, _v_ found by a test of the triangle's record. The shading data is read from the mesh
+    void computeIntersection(const Ray& ray, const float t, const float u, const float v,
+                             Intersection& isect) const;
+};
+
+/// @brief Ray-triangle intersection tests the scene can be rendered with. _MollerTrumbore_ is
+/// the fastest but rays may pass between triangles sharing an edge. _Watertight_ shears the ray
+/// space so that the edges shared by triangles are evaluated the same way for both of them and
+/// no ray passes through the seams
+enum class TriangleIntersection { MollerTrumbore, Watertight };
+
+/// @brief Intersection-ready copy of a triangle's geometry. Acceleration structures keep the
+/// records of their leaves in a contiguous array, so the innermost loop reads the vertices
+/// directly instead of loading them through the indices and the mesh. A record is made for one
+/// intersection method: Moller-Trumbore gets its edges precomputed, while the watertight method
+/// gets the vertices as they are in the mesh, so triangles sharing an edge see exactly the same
+/// edge. Accelerators make their records again when the method changes
+struct TriangleRecord {
+    Vector3f A;   ///< First vertex of the triangle
+    Vector3f P1;  ///< Edge AB for Moller-Trumbore, the second vertex B for the watertight method
+    Vector3f P2;  ///< Edge AC for Moller-Trumbore, the third vertex C for the watertight method
+
+    TriangleRecord() = default;
+
+    /// @brief Precomputes the record of _triangle_ for _method_ from its current vertex positions
+    TriangleRecord(const Triangle& triangle, const TriangleIntersection method);
+};
+
+/// @brief Sheared ray space of the watertight intersection, set up once per ray
+struct RayShear {
+    int32_t kx, ky, kz;  ///< Axes of the sheared space, _kz_ is the dominant direction axis
+    float Sx, Sy, Sz;    ///< Shear constants mapping the ray direction to the unit _kz_ axis
+};
+
+/// @brief Tests triangle records against a ray with the intersection method selected for the
+/// scene. The per-ray data of the method is set up once for all triangles tested by a query
+class TriangleIntersector {
+public:
+    TriangleIntersector(const Ray& _ray, const TriangleIntersection _method);
+
+    /// @brief Verifies if the ray intersects with the triangle of _record_. On hit within
+    /// [0, ray.tMax] records the distance _t_ and the barycentric coordinates _u_, _v_ of the
+    /// second and the third vertex
+    bool intersect(const TriangleRecord& record, float& t, float& u, float& v) const {
+        return method == TriangleIntersection::Watertight ? intersectWatertight(record, t, u, v)
+                                                          : intersectMT(record, t, u, v);
+    }
+
+    const Ray& getRay() const { return ray; }
+
+    TriangleIntersection getMethod() const { return method; }
+
+    const RayShear& getShear() const { return shear; }
+
+private:
+    /// @brief Moller-Trumbore method
+    bool intersectMT(const TriangleRecord& record, float& t, float& u, float& v) const;
+
+    /// @brief Watertight method of Woop et al. The vertices are moved to the ray origin and
+    /// sheared so the ray becomes the _kz_ axis, then the signs of the 2D edge functions decide
+    /// the hit. Edge functions that evaluate to exactly zero are computed again in double
+    /// precision, so hits on edges and vertices go to the same side for all triangles sharing them
+    bool intersectWatertight(const TriangleRecord& record, float& t, float& u, float& v) const;
+
+private:
+    const Ray& ray;                     ///< The tested ray
+    const TriangleIntersection method;  ///< The intersection method
+    RayShear shear;                     ///< Sheared ray space, set only by the watertight method
 };
 
 /// @brief Triangle mesh class that stores information for each object in the scene
@@ -45,12 +122,18 @@ struct TriangleMesh {
     std::vector<Normal3f> vertNormals;         ///< Pre-computed normals for each vertex in the mesh
     int32_t materialIdx;  ///< Index from the materials list that characterise current object (mesh)
     BBox bounds;          ///< The bounding box of the mesh
+    Vector3f velocity;    ///< Distance the vertices move per frame, zero for static meshes
 
     TriangleMesh() = delete;
 
-    /// @brief Initializes triangle mesh from vertex positions, vertex indices, and material index
-    TriangleMesh(const std::vector<Point3f>& _vertPositions,
-                 const std::vector<TriangleIndices>& _vertIndices, const int32_t _materialIdx);
+    /// @brief Initializes triangle mesh from vertex positions, vertex indices, and material index.
+    /// The vertex data is moved into the mesh
+    TriangleMesh(std::vector<Point3f> _vertPositions, std::vector<TriangleIndices> _vertIndices,
+                 const int32_t _materialIdx);
+
+    /// @brief Moves the mesh's vertices to _vertPositions_, keeping its triangles, and updates the
+    /// vertex normals and the bounds
+    void updateVertPositions(std::vector<Point3f> _vertPositions);
 
     /// @brief Retrieves a list of all triangles in the mesh upon request
     std::vector<Triangle> getTriangles() const;
@@ -58,12 +141,17 @@ struct TriangleMesh {
     /// @brief Retrieves all triangles in the mesh into _dest_ vector
     void retrieveTriangles(std::vector<Triangle>& dest) const;
 
-    /// @brief Intersects ray with the mesh and records closest intersection point if any
-    bool intersect(const Ray& ray, Intersection& isect) const;
+    /// @brief Intersects ray with the mesh using _method_ and records closest intersection point
+    /// if any
+    bool intersect(const Ray& ray, const TriangleIntersection method, Intersection& isect) const;
+
+    /// @brief Verifies if ray intersects with the mesh using _method_. Returns true on first
+    /// intersection, false if no ray-triangle intersection found. No hit attributes are computed
+    bool occluded(const Ray& ray, const TriangleIntersection method) const;
 
-    /// @brief Verifies if ray intersects with the mesh. Returns true on first intersection, false
-    /// if no ray-triangle intersection found
-    bool intersectPrim(const Ray& ray, Intersection& isect) const;
+private:
+    /// @brief Computes the vertex normals and the bounds from the vertex positions
+    void computeNormalsAndBounds();
 };
 
 #endif  // !TRIANGLE_H
@@ -0,0 +1,528 @@
+/// Own includes
+#include "TrianglePacket.h"
+#include "Statistics.h"
+
+/// System headers
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define CRT_HAS_SSE
+#endif
+#if defined(CRT_HAS_SSE) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/// @brief Compiles the function with AVX2 enabled, regardless of the flags of the build
+#if defined(CRT_HAS_SSE) && !defined(_MSC_VER)
+#define CRT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CRT_TARGET_AVX2
+#endif
+
+STAT(NUM_TRIANGLE_ISECT_TESTS, numPacketIsectTests, packetIsectTestRegisterer);
+STAT(NUM_TRIANGLE_ISECTS, numPacketIsects, packetIsectRegisterer);
+
+using PacketKernel = int32_t (*)(const TrianglePacket&, const TriangleIntersector&,
+                                 const int32_t, PacketHits&);
+
+void TrianglePacket::setLane(const int32_t lane, const TriangleRecord& record) {
+    for (int32_t axis = 0; axis < 3; axis++) {
+        A[axis][lane] = record.A[axis];
+        P1[axis][lane] = record.P1[axis];
+        P2[axis][lane] = record.P2[axis];
+    }
+}
+
+TriangleRecord TrianglePacket::getLane(const int32_t lane) const {
+    TriangleRecord record;
+    record.A = Vector3f(A[0][lane], A[1][lane], A[2][lane]);
+    record.P1 = Vector3f(P1[0][lane], P1[1][lane], P1[2][lane]);
+    record.P2 = Vector3f(P2[0][lane], P2[1][lane], P2[2][lane]);
+    return record;
+}
+
+/// @brief Tests the active lanes of _packet_ one by one, the operations are the same as the
+/// SIMD kernels' so all kernels find the same hits
+[[maybe_unused]] static int32_t intersectPacketScalar(const TrianglePacket& packet,
+                                                      const TriangleIntersector& intersector,
+                                                      const int32_t activeLanes,
+                                                      PacketHits& hits) {
+    const Ray& ray = intersector.getRay();
+    int32_t hitLanes = 0;
+    for (int32_t i = 0; i < TRIANGLE_PACKET_WIDTH; i++) {
+        if (!(activeLanes & (1 << i)))
+            continue;
+
+        const TriangleRecord record = packet.getLane(i);
+        const Vector3f& A = record.A;
+        const Vector3f& AB = record.P1;
+        const Vector3f& AC = record.P2;
+
+        const Vector3f pVec = cross(ray.dir, AC);
+        const float det = dot(AB, pVec);
+        if (fabs(det) < EPSILON)
+            continue;
+
+        const float invDet = 1 / det;
+        const Vector3f tVec = ray.origin - A;
+        const float u = dot(tVec, pVec) * invDet;
+        if (u < 0 || u > 1)
+            continue;
+
+        const Vector3f qVec = cross(tVec, AB);
+        const float v = dot(ray.dir, qVec) * invDet;
+        if (v < 0 || u + v > 1)
+            continue;
+
+        const float t = dot(AC, qVec) * invDet;
+        if (t < 0 || t > ray.tMax)
+            continue;
+
+        hits.t[i] = t;
+        hits.u[i] = u;
+        hits.v[i] = v;
+        hitLanes |= 1 << i;
+    }
+    return hitLanes;
+}
+
+/// @brief Shears the vertices of _lane_ into the ray space of _intersector_ and computes its
+/// edge functions _U_, _V_, _W_ in double precision. The kernels call it for the lanes where an
+/// edge function is exactly zero in single precision
+static void computeEdgeFunctionsDouble(const TrianglePacket& packet, const int32_t lane,
+                                       const TriangleIntersector& intersector, float& U,
+                                       float& V, float& W) {
+    const Point3f& origin = intersector.getRay().origin;
+    const RayShear& shear = intersector.getShear();
+    const int32_t kx = shear.kx;
+    const int32_t ky = shear.ky;
+    const int32_t kz = shear.kz;
+    const float Az = packet.A[kz][lane] - origin[kz];
+    const float Bz = packet.P1[kz][lane] - origin[kz];
+    const float Cz = packet.P2[kz][lane] - origin[kz];
+    const double Ax = (packet.A[kx][lane] - origin[kx]) - shear.Sx * Az;
+    const double Ay = (packet.A[ky][lane] - origin[ky]) - shear.Sy * Az;
+    const double Bx = (packet.P1[kx][lane] - origin[kx]) - shear.Sx * Bz;
+    const double By = (packet.P1[ky][lane] - origin[ky]) - shear.Sy * Bz;
+    const double Cx = (packet.P2[kx][lane] - origin[kx]) - shear.Sx * Cz;
+    const double Cy = (packet.P2[ky][lane] - origin[ky]) - shear.Sy * Cz;
+    U = (float)(Cx * By - Cy * Bx);
+    V = (float)(Ax * Cy - Ay * Cx);
+    W = (float)(Bx * Ay - By * Ax);
+}
+
+/// @brief Tests the active lanes of _packet_ one by one with the watertight method, the
+/// operations are the same as the SIMD kernels'
+[[maybe_unused]] static int32_t intersectPacketWatertightScalar(
+    const TrianglePacket& packet, const TriangleIntersector& intersector,
+    const int32_t activeLanes, PacketHits& hits) {
+    const Ray& ray = intersector.getRay();
+    const RayShear& shear = intersector.getShear();
+    const int32_t kx = shear.kx;
+    const int32_t ky = shear.ky;
+    const int32_t kz = shear.kz;
+    int32_t hitLanes = 0;
+    for (int32_t i = 0; i < TRIANGLE_PACKET_WIDTH; i++) {
+        if (!(activeLanes & (1 << i)))
+            continue;
+
+        const TriangleRecord record = packet.getLane(i);
+        const Vector3f A = record.A - ray.origin;
+        const Vector3f B = record.P1 - ray.origin;
+        const Vector3f C = record.P2 - ray.origin;
+        const float Ax = A[kx] - shear.Sx * A[kz];
+        const float Ay = A[ky] - shear.Sy * A[kz];
+        const float Bx = B[kx] - shear.Sx * B[kz];
+        const float By = B[ky] - shear.Sy * B[kz];
+        const float Cx = C[kx] - shear.Sx * C[kz];
+        const float Cy = C[ky] - shear.Sy * C[kz];
+
+        float U = Cx * By - Cy * Bx;
+        float V = Ax * Cy - Ay * Cx;
+        float W = Bx * Ay - By * Ax;
+        if (U == 0.f || V == 0.f || W == 0.f)
+            computeEdgeFunctionsDouble(packet, i, intersector, U, V, W);
+
+        if ((U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0))
+            continue;
+
+        const float det = U + V + W;
+        if (det == 0.f)
+            continue;
+
+        const float T = U * (shear.Sz * A[kz]) + V * (shear.Sz * B[kz]) + W * (shear.Sz * C[kz]);
+        const float invDet = 1 / det;
+        const float t = T * invDet;
+        if (t < 0 || t > ray.tMax)
+            continue;
+
+        hits.t[i] = t;
+        hits.u[i] = V * invDet;
+        hits.v[i] = W * invDet;
+        hitLanes |= 1 << i;
+    }
+    return hitLanes;
+}
+
+#if defined(CRT_HAS_SSE)
+/// @brief Tests the packet's lanes in two halves of 4 with SSE
+static int32_t intersectPacketSSE(const TrianglePacket& packet,
+                                  const TriangleIntersector& intersector, const int32_t,
+                                  PacketHits& hits) {
+    const Ray& ray = intersector.getRay();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 signMask = _mm_set1_ps(-0.f);
+    const __m128 epsilon = _mm_set1_ps(EPSILON);
+    const __m128 tMax = _mm_set1_ps(ray.tMax);
+    const __m128 dirX = _mm_set1_ps(ray.dir.x);
+    const __m128 dirY = _mm_set1_ps(ray.dir.y);
+    const __m128 dirZ = _mm_set1_ps(ray.dir.z);
+
+    int32_t hitLanes = 0;
+    for (int32_t half = 0; half < TRIANGLE_PACKET_WIDTH; half += 4) {
+        const __m128 Ax = _mm_load_ps(&packet.A[0][half]);
+        const __m128 Ay = _mm_load_ps(&packet.A[1][half]);
+        const __m128 Az = _mm_load_ps(&packet.A[2][half]);
+        const __m128 ABx = _mm_load_ps(&packet.P1[0][half]);
+        const __m128 ABy = _mm_load_ps(&packet.P1[1][half]);
+        const __m128 ABz = _mm_load_ps(&packet.P1[2][half]);
+        const __m128 ACx = _mm_load_ps(&packet.P2[0][half]);
+        const __m128 ACy = _mm_load_ps(&packet.P2[1][half]);
+        const __m128 ACz = _mm_load_ps(&packet.P2[2][half]);
+
+        // pVec = cross(dir, AC), det = dot(AB, pVec)
+        const __m128 pX = _mm_sub_ps(_mm_mul_ps(dirY, ACz), _mm_mul_ps(dirZ, ACy));
+        const __m128 pY = _mm_sub_ps(_mm_mul_ps(dirZ, ACx), _mm_mul_ps(dirX, ACz));
+        const __m128 pZ = _mm_sub_ps(_mm_mul_ps(dirX, ACy), _mm_mul_ps(dirY, ACx));
+        const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ABx, pX), _mm_mul_ps(ABy, pY)),
+                                      _mm_mul_ps(ABz, pZ));
+        __m128 miss = _mm_cmplt_ps(_mm_andnot_ps(signMask, det), epsilon);
+        const __m128 invDet = _mm_div_ps(one, det);
+
+        // tVec = origin - A, u = dot(tVec, pVec) * invDet
+        const __m128 tX = _mm_sub_ps(_mm_set1_ps(ray.origin.x), Ax);
+        const __m128 tY = _mm_sub_ps(_mm_set1_ps(ray.origin.y), Ay);
+        const __m128 tZ = _mm_sub_ps(_mm_set1_ps(ray.origin.z), Az);
+        const __m128 u = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(tX, pX), _mm_mul_ps(tY, pY)), _mm_mul_ps(tZ, pZ)),
+            invDet);
+        miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmpgt_ps(u, one)));
+
+        // qVec = cross(tVec, AB), v = dot(dir, qVec) * invDet
+        const __m128 qX = _mm_sub_ps(_mm_mul_ps(tY, ABz), _mm_mul_ps(tZ, ABy));
+        const __m128 qY = _mm_sub_ps(_mm_mul_ps(tZ, ABx), _mm_mul_ps(tX, ABz));
+        const __m128 qZ = _mm_sub_ps(_mm_mul_ps(tX, ABy), _mm_mul_ps(tY, ABx));
+        const __m128 v = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(dirX, qX), _mm_mul_ps(dirY, qY)),
+                       _mm_mul_ps(dirZ, qZ)),
+            invDet);
+        miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(v, zero),
+                                         _mm_cmpgt_ps(_mm_add_ps(u, v), one)));
+
+        // t = dot(AC, qVec) * invDet
+        const __m128 t = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(ACx, qX), _mm_mul_ps(ACy, qY)), _mm_mul_ps(ACz, qZ)),
+            invDet);
+        miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(t, zero), _mm_cmpgt_ps(t, tMax)));
+
+        _mm_store_ps(&hits.t[half], t);
+        _mm_store_ps(&hits.u[half], u);
+        _mm_store_ps(&hits.v[half], v);
+        hitLanes |= (~_mm_movemask_ps(miss) & 0xF) << half;
+    }
+    return hitLanes;
+}
+
+/// @brief Tests the packet's lanes in two halves of 4 with SSE using the watertight method
+static int32_t intersectPacketWatertightSSE(const TrianglePacket& packet,
+                                            const TriangleIntersector& intersector,
+                                            const int32_t activeLanes, PacketHits& hits) {
+    const Ray& ray = intersector.getRay();
+    const RayShear& shear = intersector.getShear();
+    const int32_t kx = shear.kx;
+    const int32_t ky = shear.ky;
+    const int32_t kz = shear.kz;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 tMax = _mm_set1_ps(ray.tMax);
+    const __m128 Sx = _mm_set1_ps(shear.Sx);
+    const __m128 Sy = _mm_set1_ps(shear.Sy);
+    const __m128 Sz = _mm_set1_ps(shear.Sz);
+    const __m128 orgX = _mm_set1_ps(ray.origin[kx]);
+    const __m128 orgY = _mm_set1_ps(ray.origin[ky]);
+    const __m128 orgZ = _mm_set1_ps(ray.origin[kz]);
+
+    int32_t hitLanes = 0;
+    for (int32_t half = 0; half < TRIANGLE_PACKET_WIDTH; half += 4) {
+        // moves the vertices to the ray origin and shears them so the ray runs along z
+        const __m128 Az = _mm_sub_ps(_mm_load_ps(&packet.A[kz][half]), orgZ);
+        const __m128 Bz = _mm_sub_ps(_mm_load_ps(&packet.P1[kz][half]), orgZ);
+        const __m128 Cz = _mm_sub_ps(_mm_load_ps(&packet.P2[kz][half]), orgZ);
+        const __m128 Ax = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&packet.A[kx][half]), orgX),
+                                     _mm_mul_ps(Sx, Az));
+        const __m128 Ay = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&packet.A[ky][half]), orgY),
+                                     _mm_mul_ps(Sy, Az));
+        const __m128 Bx = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&packet.P1[kx][half]), orgX),
+                                     _mm_mul_ps(Sx, Bz));
+        const __m128 By = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&packet.P1[ky][half]), orgY),
+                                     _mm_mul_ps(Sy, Bz));
+        const __m128 Cx = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&packet.P2[kx][half]), orgX),
+                                     _mm_mul_ps(Sx, Cz));
+        const __m128 Cy = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(&packet.P2[ky][half]), orgY),
+                                     _mm_mul_ps(Sy, Cz));
+
+        // edge functions, the active lanes with a zero one are computed again in double
+        __m128 U = _mm_sub_ps(_mm_mul_ps(Cx, By), _mm_mul_ps(Cy, Bx));
+        __m128 V = _mm_sub_ps(_mm_mul_ps(Ax, Cy), _mm_mul_ps(Ay, Cx));
+        __m128 W = _mm_sub_ps(_mm_mul_ps(Bx, Ay), _mm_mul_ps(By, Ax));
+        const __m128 ties = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(U, zero), _mm_cmpeq_ps(V, zero)),
+                                      _mm_cmpeq_ps(W, zero));
+        const int32_t tieLanes = _mm_movemask_ps(ties) & (activeLanes >> half);
+        if (tieLanes) {
+            alignas(16) float edges[3][4];
+            _mm_store_ps(edges[0], U);
+            _mm_store_ps(edges[1], V);
+            _mm_store_ps(edges[2], W);
+            for (int32_t i = 0; i < 4; i++) {
+                if (tieLanes & (1 << i))
+                    computeEdgeFunctionsDouble(packet, half + i, intersector, edges[0][i],
+                                               edges[1][i], edges[2][i]);
+            }
+            U = _mm_load_ps(edges[0]);
+            V = _mm_load_ps(edges[1]);
+            W = _mm_load_ps(edges[2]);
+        }
+
+        // the ray misses if the edge functions have different signs or the triangle is
+        // degenerate
+        const __m128 anyNeg = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(U, zero), _mm_cmplt_ps(V, zero)),
+                                        _mm_cmplt_ps(W, zero));
+        const __m128 anyPos = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(U, zero), _mm_cmpgt_ps(V, zero)),
+                                        _mm_cmpgt_ps(W, zero));
+        const __m128 det = _mm_add_ps(_mm_add_ps(U, V), W);
+        __m128 miss = _mm_or_ps(_mm_and_ps(anyNeg, anyPos), _mm_cmpeq_ps(det, zero));
+
+        // interpolates the sheared distances of the vertices
+        const __m128 invDet = _mm_div_ps(one, det);
+        const __m128 T = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(U, _mm_mul_ps(Sz, Az)), _mm_mul_ps(V, _mm_mul_ps(Sz, Bz))),
+            _mm_mul_ps(W, _mm_mul_ps(Sz, Cz)));
+        const __m128 t = _mm_mul_ps(T, invDet);
+        miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(t, zero), _mm_cmpgt_ps(t, tMax)));
+
+        _mm_store_ps(&hits.t[half], t);
+        _mm_store_ps(&hits.u[half], _mm_mul_ps(V, invDet));
+        _mm_store_ps(&hits.v[half], _mm_mul_ps(W, invDet));
+        hitLanes |= (~_mm_movemask_ps(miss) & 0xF) << half;
+    }
+    return hitLanes;
+}
+
+/// @brief Tests all lanes of the packet at once with AVX2
+CRT_TARGET_AVX2 static int32_t intersectPacketAVX2(const TrianglePacket& packet,
+                                                   const TriangleIntersector& intersector,
+                                                   const int32_t, PacketHits& hits) {
+    static_assert(TRIANGLE_PACKET_WIDTH == 8, "The AVX2 kernel tests 8 triangles at once");
+    const Ray& ray = intersector.getRay();
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 dirX = _mm256_set1_ps(ray.dir.x);
+    const __m256 dirY = _mm256_set1_ps(ray.dir.y);
+    const __m256 dirZ = _mm256_set1_ps(ray.dir.z);
+    const __m256 Ax = _mm256_load_ps(packet.A[0]);
+    const __m256 Ay = _mm256_load_ps(packet.A[1]);
+    const __m256 Az = _mm256_load_ps(packet.A[2]);
+    const __m256 ABx = _mm256_load_ps(packet.P1[0]);
+    const __m256 ABy = _mm256_load_ps(packet.P1[1]);
+    const __m256 ABz = _mm256_load_ps(packet.P1[2]);
+    const __m256 ACx = _mm256_load_ps(packet.P2[0]);
+    const __m256 ACy = _mm256_load_ps(packet.P2[1]);
+    const __m256 ACz = _mm256_load_ps(packet.P2[2]);
+
+    // pVec = cross(dir, AC), det = dot(AB, pVec)
+    const __m256 pX = _mm256_sub_ps(_mm256_mul_ps(dirY, ACz), _mm256_mul_ps(dirZ, ACy));
+    const __m256 pY = _mm256_sub_ps(_mm256_mul_ps(dirZ, ACx), _mm256_mul_ps(dirX, ACz));
+    const __m256 pZ = _mm256_sub_ps(_mm256_mul_ps(dirX, ACy), _mm256_mul_ps(dirY, ACx));
+    const __m256 det = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(ABx, pX), _mm256_mul_ps(ABy, pY)), _mm256_mul_ps(ABz, pZ));
+    __m256 miss = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), det),
+                                _mm256_set1_ps(EPSILON), _CMP_LT_OQ);
+    const __m256 invDet = _mm256_div_ps(one, det);
+
+    // tVec = origin - A, u = dot(tVec, pVec) * invDet
+    const __m256 tX = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), Ax);
+    const __m256 tY = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), Ay);
+    const __m256 tZ = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), Az);
+    const __m256 u = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tX, pX), _mm256_mul_ps(tY, pY)),
+                      _mm256_mul_ps(tZ, pZ)),
+        invDet);
+    miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ),
+                                           _mm256_cmp_ps(u, one, _CMP_GT_OQ)));
+
+    // qVec = cross(tVec, AB), v = dot(dir, qVec) * invDet
+    const __m256 qX = _mm256_sub_ps(_mm256_mul_ps(tY, ABz), _mm256_mul_ps(tZ, ABy));
+    const __m256 qY = _mm256_sub_ps(_mm256_mul_ps(tZ, ABx), _mm256_mul_ps(tX, ABz));
+    const __m256 qZ = _mm256_sub_ps(_mm256_mul_ps(tX, ABy), _mm256_mul_ps(tY, ABx));
+    const __m256 v = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dirX, qX), _mm256_mul_ps(dirY, qY)),
+                      _mm256_mul_ps(dirZ, qZ)),
+        invDet);
+    miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ),
+                                           _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_GT_OQ)));
+
+    // t = dot(AC, qVec) * invDet
+    const __m256 t = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ACx, qX), _mm256_mul_ps(ACy, qY)),
+                      _mm256_mul_ps(ACz, qZ)),
+        invDet);
+    miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(t, zero, _CMP_LT_OQ),
+                                           _mm256_cmp_ps(t, _mm256_set1_ps(ray.tMax),
+                                                         _CMP_GT_OQ)));
+
+    _mm256_store_ps(hits.t, t);
+    _mm256_store_ps(hits.u, u);
+    _mm256_store_ps(hits.v, v);
+    return ~_mm256_movemask_ps(miss) & 0xFF;
+}
+
+/// @brief Tests all lanes of the packet at once with AVX2 using the watertight method
+CRT_TARGET_AVX2 static int32_t intersectPacketWatertightAVX2(
+    const TrianglePacket& packet, const TriangleIntersector& intersector,
+    const int32_t activeLanes, PacketHits& hits) {
+    const Ray& ray = intersector.getRay();
+    const RayShear& shear = intersector.getShear();
+    const int32_t kx = shear.kx;
+    const int32_t ky = shear.ky;
+    const int32_t kz = shear.kz;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 Sx = _mm256_set1_ps(shear.Sx);
+    const __m256 Sy = _mm256_set1_ps(shear.Sy);
+    const __m256 Sz = _mm256_set1_ps(shear.Sz);
+    const __m256 orgX = _mm256_set1_ps(ray.origin[kx]);
+    const __m256 orgY = _mm256_set1_ps(ray.origin[ky]);
+    const __m256 orgZ = _mm256_set1_ps(ray.origin[kz]);
+
+    // moves the vertices to the ray origin and shears them so the ray runs along z
+    const __m256 Az = _mm256_sub_ps(_mm256_load_ps(packet.A[kz]), orgZ);
+    const __m256 Bz = _mm256_sub_ps(_mm256_load_ps(packet.P1[kz]), orgZ);
+    const __m256 Cz = _mm256_sub_ps(_mm256_load_ps(packet.P2[kz]), orgZ);
+    const __m256 Ax = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(packet.A[kx]), orgX),
+                                    _mm256_mul_ps(Sx, Az));
+    const __m256 Ay = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(packet.A[ky]), orgY),
+                                    _mm256_mul_ps(Sy, Az));
+    const __m256 Bx = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(packet.P1[kx]), orgX),
+                                    _mm256_mul_ps(Sx, Bz));
+    const __m256 By = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(packet.P1[ky]), orgY),
+                                    _mm256_mul_ps(Sy, Bz));
+    const __m256 Cx = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(packet.P2[kx]), orgX),
+                                    _mm256_mul_ps(Sx, Cz));
+    const __m256 Cy = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(packet.P2[ky]), orgY),
+                                    _mm256_mul_ps(Sy, Cz));
+
+    // edge functions, the active lanes with a zero one are computed again in double
+    __m256 U = _mm256_sub_ps(_mm256_mul_ps(Cx, By), _mm256_mul_ps(Cy, Bx));
+    __m256 V = _mm256_sub_ps(_mm256_mul_ps(Ax, Cy), _mm256_mul_ps(Ay, Cx));
+    __m256 W = _mm256_sub_ps(_mm256_mul_ps(Bx, Ay), _mm256_mul_ps(By, Ax));
+    const __m256 ties = _mm256_or_ps(
+        _mm256_or_ps(_mm256_cmp_ps(U, zero, _CMP_EQ_OQ), _mm256_cmp_ps(V, zero, _CMP_EQ_OQ)),
+        _mm256_cmp_ps(W, zero, _CMP_EQ_OQ));
+    const int32_t tieLanes = _mm256_movemask_ps(ties) & activeLanes;
+    if (tieLanes) {
+        alignas(32) float edges[3][TRIANGLE_PACKET_WIDTH];
+        _mm256_store_ps(edges[0], U);
+        _mm256_store_ps(edges[1], V);
+        _mm256_store_ps(edges[2], W);
+        for (int32_t i = 0; i < TRIANGLE_PACKET_WIDTH; i++) {
+            if (tieLanes & (1 << i))
+                computeEdgeFunctionsDouble(packet, i, intersector, edges[0][i], edges[1][i],
+                                           edges[2][i]);
+        }
+        U = _mm256_load_ps(edges[0]);
+        V = _mm256_load_ps(edges[1]);
+        W = _mm256_load_ps(edges[2]);
+    }
+
+    // the ray misses if the edge functions have different signs or the triangle is degenerate
+    const __m256 anyNeg = _mm256_or_ps(
+        _mm256_or_ps(_mm256_cmp_ps(U, zero, _CMP_LT_OQ), _mm256_cmp_ps(V, zero, _CMP_LT_OQ)),
+        _mm256_cmp_ps(W, zero, _CMP_LT_OQ));
+    const __m256 anyPos = _mm256_or_ps(
+        _mm256_or_ps(_mm256_cmp_ps(U, zero, _CMP_GT_OQ), _mm256_cmp_ps(V, zero, _CMP_GT_OQ)),
+        _mm256_cmp_ps(W, zero, _CMP_GT_OQ));
+    const __m256 det = _mm256_add_ps(_mm256_add_ps(U, V), W);
+    __m256 miss = _mm256_or_ps(_mm256_and_ps(anyNeg, anyPos), _mm256_cmp_ps(det, zero, _CMP_EQ_OQ));
+
+    // interpolates the sheared distances of the vertices
+    const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+    const __m256 T = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(U, _mm256_mul_ps(Sz, Az)),
+                                                 _mm256_mul_ps(V, _mm256_mul_ps(Sz, Bz))),
+                                   _mm256_mul_ps(W, _mm256_mul_ps(Sz, Cz)));
+    const __m256 t = _mm256_mul_ps(T, invDet);
+    miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(t, zero, _CMP_LT_OQ),
+                                           _mm256_cmp_ps(t, _mm256_set1_ps(ray.tMax),
+                                                         _CMP_GT_OQ)));
+
+    _mm256_store_ps(hits.t, t);
+    _mm256_store_ps(hits.u, _mm256_mul_ps(V, invDet));
+    _mm256_store_ps(hits.v, _mm256_mul_ps(W, invDet));
+    return ~_mm256_movemask_ps(miss) & 0xFF;
+}
+
+/// @brief Verifies if both the CPU and the OS support AVX2
+static bool cpuSupportsAVX2() {
+#if defined(_MSC_VER)
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 0);
+    if (cpuInfo[0] < 7)
+        return false;
+
+    // the OS must save the AVX registers on context switch
+    __cpuid(cpuInfo, 1);
+    const bool hasOSXSave = cpuInfo[2] & (1 << 27);
+    const bool hasAVX = cpuInfo[2] & (1 << 28);
+    if (!hasOSXSave || !hasAVX || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(cpuInfo, 7, 0);
+    return cpuInfo[1] & (1 << 5);
+#else
+    __builtin_cpu_init();  // the check runs during static initialization
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif  // CRT_HAS_SSE
+
+/// @brief Kernel selected once for the CPU the renderer runs on
+struct PacketKernelInfo {
+    PacketKernel kernel;            ///< Function testing the packet with Moller-Trumbore method
+    PacketKernel watertightKernel;  ///< Function testing the packet with the watertight method
+    const char* name;               ///< Name of the kernels' instruction set
+};
+
+static PacketKernelInfo selectPacketKernel() {
+#if defined(CRT_HAS_SSE)
+    if (cpuSupportsAVX2())
+        return {intersectPacketAVX2, intersectPacketWatertightAVX2, "AVX2"};
+    return {intersectPacketSSE, intersectPacketWatertightSSE, "SSE"};
+#else
+    return {intersectPacketScalar, intersectPacketWatertightScalar, "scalar"};
+#endif
+}
+
+static const PacketKernelInfo packetKernelInfo = selectPacketKernel();
+
+int32_t intersectPacket(const TrianglePacket& packet, const TriangleIntersector& intersector,
+                        const int32_t activeLanes, PacketHits& hits) {
+    const PacketKernel kernel = intersector.getMethod() == TriangleIntersection::Watertight
+                                    ? packetKernelInfo.watertightKernel
+                                    : packetKernelInfo.kernel;
+    const int32_t hitLanes = kernel(packet, intersector, activeLanes, hits) & activeLanes;
+    for (int32_t i = 0; i < TRIANGLE_PACKET_WIDTH; i++) {
+        numPacketIsectTests += (activeLanes >> i) & 1;
+        numPacketIsects += (hitLanes >> i) & 1;
+    }
+    return hitLanes;
+}
+
+const char* getPacketKernelName() { return packetKernelInfo.name; }
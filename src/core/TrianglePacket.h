@@ -0,0 +1,38 @@
+#ifndef TRIANGLEPACKET_H
+#define TRIANGLEPACKET_H
+
+#include "Triangle.h"
+
+/// @brief Intersection records of TRIANGLE_PACKET_WIDTH triangles in SoA layout, so a single
+/// SIMD kernel tests all of them against one ray. Unused lanes are zero filled degenerate
+/// triangles
+struct alignas(32) TrianglePacket {
+    float A[3][TRIANGLE_PACKET_WIDTH];   ///< First vertices per axis
+    float P1[3][TRIANGLE_PACKET_WIDTH];  ///< The records' P1 per axis, edge AB or vertex B
+    float P2[3][TRIANGLE_PACKET_WIDTH];  ///< The records' P2 per axis, edge AC or vertex C
+
+    /// @brief Stores _record_ in _lane_
+    void setLane(const int32_t lane, const TriangleRecord& record);
+
+    /// @brief Gathers the record stored in _lane_
+    TriangleRecord getLane(const int32_t lane) const;
+};
+
+/// @brief Distances and barycentric coordinates of the packet's lanes hit by a ray
+struct alignas(32) PacketHits {
+    float t[TRIANGLE_PACKET_WIDTH];  ///< Distances from the ray origin to the hits
+    float u[TRIANGLE_PACKET_WIDTH];  ///< Barycentric coordinate of the second vertex
+    float v[TRIANGLE_PACKET_WIDTH];  ///< Barycentric coordinate of the third vertex
+};
+
+/// @brief Tests the lanes of _packet_ set in the bitmask _activeLanes_ against the ray of
+/// _intersector_ using its intersection method. Returns bitmask of the lanes hit within
+/// [0, ray.tMax] and records their hits in _hits_. Runs the AVX2 or SSE kernels selected for the
+/// CPU at startup, or the scalar fallback
+int32_t intersectPacket(const TrianglePacket& packet, const TriangleIntersector& intersector,
+                        const int32_t activeLanes, PacketHits& hits);
+
+/// @brief Name of the kernel intersectPacket runs on this CPU
+const char* getPacketKernelName();
+
+#endif  // !TRIANGLEPACKET_H
@@ -0,0 +1,152 @@
+/// Own includes
+#include "TwoLevelAccel.h"
+#include "Timer.h"
+
+/// System headers
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+/// @brief Computes the world bounds of _objectBounds_ placed by _meshInstance_ from its corners
+static BBox transformBounds(const BBox& objectBounds, const MeshInstance& meshInstance) {
+    BBox worldBounds;
+    for (int32_t corner = 0; corner < 8; corner++) {
+        const Point3f objectCorner((corner & 1) ? objectBounds.max.x : objectBounds.min.x,
+                                   (corner & 2) ? objectBounds.max.y : objectBounds.min.y,
+                                   (corner & 4) ? objectBounds.max.z : objectBounds.min.z);
+        worldBounds.expandBy(objectCorner * meshInstance.transform + meshInstance.translation);
+    }
+    return worldBounds;
+}
+
+TwoLevelAccel::TwoLevelAccel(const std::vector<TriangleMesh>& _meshes,
+                             std::vector<std::unique_ptr<Accelerator>> _meshAccels,
+                             const std::vector<MeshInstance>& _meshInstances,
+                             const BVHSettings& bvhSettings)
+    : meshes(_meshes),
+      meshInstances(_meshInstances),
+      settings(bvhSettings),
+      meshAccels(std::move(_meshAccels)) {
+    Assert(meshes.size() == meshAccels.size());
+    Timer timer;
+    timer.start();
+    buildTopLevel();
+
+    std::cout << "Top level BVH over " << instances.size() << " instances of " << meshes.size()
+              << " meshes build for [" << std::fixed << std::setprecision(2)
+              << Timer::toMilliSec<float>(timer.getElapsedNanoSec()) << "ms]\n";
+}
+
+bool TwoLevelAccel::canRefit() const {
+    return std::all_of(meshAccels.begin(), meshAccels.end(),
+                       [](const auto& meshAccel) { return meshAccel->canRefit(); });
+}
+
+bool TwoLevelAccel::refit(ThreadPool* pool) {
+    // a partly refit structure would be inconsistent, so nothing is changed unless all can be
+    if (!canRefit())
+        return false;
+
+    for (const auto& meshAccel : meshAccels)
+        meshAccel->refit(pool);
+
+    // the top level holds few instances, building it again is cheaper than refitting it
+    buildTopLevel();
+    return true;
+}
+
+void TwoLevelAccel::buildTopLevel() {
+    bounds = BBox();
+    std::vector<BBox> instanceBounds(meshInstances.size());
+    for (size_t i = 0; i < meshInstances.size(); i++) {
+        instanceBounds[i] = transformBounds(meshes[meshInstances[i].meshIdx].bounds,
+                                            meshInstances[i]);
+        bounds.unionWith(instanceBounds[i]);
+    }
+
+    // the instances are stored in the order the top level's leaves reference them
+    const std::vector<int32_t> leafOrder = topLevel.build(instanceBounds, settings);
+    instances.clear();
+    instances.reserve(meshInstances.size());
+    for (const int32_t instanceIdx : leafOrder) {
+        const MeshInstance& meshInstance = meshInstances[instanceIdx];
+        Instance& instance = instances.emplace_back();
+        instance.meshAccel = meshAccels[meshInstance.meshIdx].get();
+        instance.worldToObject = inverse(meshInstance.transform);
+        instance.normalToWorld = transpose(instance.worldToObject);
+        instance.translation = meshInstance.translation;
+        instance.materialIdx = meshInstance.materialIdx;
+    }
+}
+
+void TwoLevelAccel::setTriangleIntersection(const TriangleIntersection method) {
+    Accelerator::setTriangleIntersection(method);
+    for (auto& meshAccel : meshAccels)
+        meshAccel->setTriangleIntersection(method);
+}
+
+Ray TwoLevelAccel::toObjectSpace(const Ray& ray, const Instance& instance) {
+    Ray objectRay(ray);
+    objectRay.origin = (ray.origin - instance.translation) * instance.worldToObject;
+    objectRay.dir = ray.dir * instance.worldToObject;
+    return objectRay;
+}
+
+void TwoLevelAccel::toWorldSpace(const Ray& ray, const Instance& instance,
+                                 Intersection& isectData) {
+    isectData.pos = ray.at(isectData.t);
+    if (instance.materialIdx >= 0)
+        isectData.materialIdx = instance.materialIdx;
+    isectData.faceNormal = (isectData.faceNormal * instance.normalToWorld).normalize();
+
+    // the interpolated normal keeps the length the bottom level computed it with
+    const float smoothNormalLength = isectData.smoothNormal.length();
+    isectData.smoothNormal =
+        (isectData.smoothNormal * instance.normalToWorld).normalize() * smoothNormalLength;
+}
+
+bool TwoLevelAccel::intersect(const Ray& ray, Intersection& isectData) const {
+    bool hasIntersect = false;
+    Intersection closestPrim;
+    topLevel.traverse(ray, [&](const BVHTree::Node& leaf) -> bool {
+        // search for the closest intersection with the leaf's instances, the object space ray
+        // shares the parametric distances so the closest hit limits the following instances
+        const int32_t instancesEnd = leaf.primsOffset() + leaf.numPrims();
+        for (int32_t i = leaf.primsOffset(); i < instancesEnd; ++i) {
+            const Ray objectRay = toObjectSpace(ray, instances[i]);
+            if (instances[i].meshAccel->intersect(objectRay, isectData) &&
+                isectData.t < closestPrim.t) {
+                toWorldSpace(ray, instances[i], isectData);
+                closestPrim = isectData;
+                ray.tMax = isectData.t;
+                hasIntersect = true;
+            }
+        }
+        return false;
+    });
+
+    if (hasIntersect)
+        isectData = closestPrim;
+
+    return hasIntersect;
+}
+
+bool TwoLevelAccel::occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const {
+    // the material override decides for all triangles of an instance, so transparent instances
+    // are skipped and the opaque ones are blocked by any of their triangles
+    static const OpaqueMaterials allMaterialsOpaque;
+    return topLevel.traverse(ray, [&](const BVHTree::Node& leaf) -> bool {
+        const int32_t instancesEnd = leaf.primsOffset() + leaf.numPrims();
+        for (int32_t i = leaf.primsOffset(); i < instancesEnd; ++i) {
+            const Instance& instance = instances[i];
+            if (instance.materialIdx >= 0 && !isOpaque(opaqueMaterials, instance.materialIdx))
+                continue;
+
+            const Ray objectRay = toObjectSpace(ray, instance);
+            if (instance.meshAccel->occluded(
+                    objectRay, instance.materialIdx >= 0 ? allMaterialsOpaque : opaqueMaterials))
+                return true;
+        }
+        return false;
+    });
+}
@@ -0,0 +1,68 @@
+#ifndef TWOLEVELACCEL_H
+#define TWOLEVELACCEL_H
+
+#include <memory>
+#include "BVH.h"
+#include "Matrix3x3.h"
+
+/// @brief Two-level acceleration structure. Each mesh has a bottom-level structure built in its
+/// object space and shared by all of its instances, while a top-level BVH over the instances'
+/// world bounds finds the instances a ray may hit. The ray is transformed into the object space
+/// of the instance instead of transforming the geometry
+class TwoLevelAccel : public Accelerator {
+private:
+    /// @brief Instance data used during traversal
+    struct Instance {
+        const Accelerator* meshAccel;  ///< Bottom-level structure of the instanced mesh
+        Matrix3x3 worldToObject;       ///< Inverse of the instance's rotation and scale
+        Matrix3x3 normalToWorld;       ///< Inverse transpose used to transform the normals
+        Vector3f translation;          ///< Object to world translation
+        int32_t materialIdx;           ///< Material override, negative if there is none
+    };
+
+public:
+    /// @brief Builds the top level over _meshInstances_ of _meshes_. _meshAccels_ keeps the
+    /// bottom-level structure of each mesh in the order of _meshes_
+    TwoLevelAccel(const std::vector<TriangleMesh>& meshes,
+                  std::vector<std::unique_ptr<Accelerator>> _meshAccels,
+                  const std::vector<MeshInstance>& meshInstances, const BVHSettings& bvhSettings);
+
+    bool intersect(const Ray& ray, Intersection& isectData) const override;
+
+    bool occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const override;
+
+    /// @brief Verifies if the bottom-level structures of all meshes can be refit
+    bool canRefit() const override;
+
+    /// @brief Refits the bottom-level structures of all meshes and builds the top level over the
+    /// moved instance bounds again. Fails without changing any of them if one can't be refit
+    bool refit(ThreadPool* pool) override;
+
+    /// @brief Selects the intersection method of the bottom-level structures
+    void setTriangleIntersection(const TriangleIntersection method) override;
+
+    const BBox& getBounds() const { return bounds; }
+
+private:
+    /// @brief Builds the top-level BVH over the current bounds of the instanced meshes
+    void buildTopLevel();
+
+    /// @brief Transforms _ray_ into the object space of _instance_. The direction isn't
+    /// normalized so distances along the ray are the same in both spaces
+    static Ray toObjectSpace(const Ray& ray, const Instance& instance);
+
+    /// @brief Transforms the intersection found with _instance_ along _ray_ into world space and
+    /// applies the instance's material override
+    static void toWorldSpace(const Ray& ray, const Instance& instance, Intersection& isectData);
+
+private:
+    const std::vector<TriangleMesh>& meshes;               ///< The instanced meshes
+    const std::vector<MeshInstance> meshInstances;         ///< Instances in the input order
+    const BVHSettings settings;                            ///< Settings of the top-level build
+    BVHTree topLevel;                                      ///< BVH over the instances' bounds
+    std::vector<Instance> instances;                       ///< Instances in leaf order
+    std::vector<std::unique_ptr<Accelerator>> meshAccels;  ///< Bottom-level structure per mesh
+    BBox bounds;                                           ///< World bounds of all instances
+};
+
+#endif  // !TWOLEVELACCEL_H
@@ -109,4 +109,60 @@ inline static BBox getTriangleBBox(const Triangle& triangle) {
     return triangleBBox;
 }
 
+/// @brief Accumulates _size_ bytes starting at _data_ into the 64-bit FNV-1a _hash_
+inline static uint64_t hashBytes(const void* data, const size_t size,
+                                 uint64_t hash = FNV_OFFSET_BASIS) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/// @brief Fixed-capacity LIFO container that lives on the call stack. Used as traversal stack
+/// of the acceleration structures so that queries do not touch the heap allocator
+template <typename T, size_t Capacity>
+class FixedStack {
+public:
+    void push(const T& item) {
+        Assert(count < Capacity && "FixedStack capacity exceeded");
+        items[count++] = item;
+    }
+
+    T pop() {
+        Assert(count > 0 && "Can't pop from empty FixedStack");
+        return items[--count];
+    }
+
+    bool empty() const { return count == 0; }
+
+private:
+    T items[Capacity];  ///< Storage for the stacked items
+    size_t count = 0;   ///< Number of items currently on the stack
+};
+
+/// @brief Small direct-mapped cache of the primitives already tested against a ray. Lives on the
+/// call stack for the duration of a single query, so primitives referenced by several leaves of
+/// the acceleration structure are tested once per ray
+template <size_t Capacity>
+class Mailbox {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Mailbox capacity must be power of two");
+
+public:
+    Mailbox() { std::fill(std::begin(primIds), std::end(primIds), -1); }
+
+    /// @brief Returns true if _primId_ was already tested against the ray, records it otherwise
+    bool testAndSet(const int32_t primId) {
+        int32_t& slot = primIds[primId & (Capacity - 1)];
+        if (slot == primId)
+            return true;
+        slot = primId;
+        return false;
+    }
+
+private:
+    int32_t primIds[Capacity];  ///< Ids of the recently tested primitives, -1 for empty slots
+};
+
 #endif  // !UTILS_H
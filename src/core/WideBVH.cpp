@@ -0,0 +1,287 @@
+/// Own includes
+#include "WideBVH.h"
+#include "Timer.h"
+
+/// System headers
+#include <iomanip>
+#include <iostream>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+template <int32_t Width>
+WideBVH<Width>::WideBVH(BVH&& binaryBVH)
+    : triangles(std::move(binaryBVH.triangles)),
+      triangleRecords(std::move(binaryBVH.triangleRecords)) {
+    isectMethod = binaryBVH.isectMethod;  // the records were made for it
+    Timer timer;
+    timer.start();
+    const std::vector<BVHTree::Node>& binaryNodes = binaryBVH.tree.getNodes();
+    if (!binaryNodes.empty()) {
+        if (binaryNodes[0].isLeaf()) {  // single leaf is kept as the only child of the root
+            const int32_t rootChildren[1] = {0};
+            addNode(binaryNodes, rootChildren, 1);
+        } else {
+            collapse(binaryNodes, 0);
+        }
+    }
+    binaryBVH.tree = {};
+    nodes.shrink_to_fit();
+
+    const size_t bvhBytes = nodes.size() * sizeof(Node);
+    std::cout << Width << "-wide BVH with " << nodes.size() << " nodes [" << bvhBytes / 1024
+              << "KB] collapsed for [" << std::fixed << std::setprecision(2)
+              << Timer::toMilliSec<float>(timer.getElapsedNanoSec()) << "ms]\n";
+}
+
+template <int32_t Width>
+int32_t WideBVH<Width>::collapse(const std::vector<BVHTree::Node>& binaryNodes,
+                                 const int32_t binaryNodeIdx) {
+    const auto nodeSurfaceArea = [&binaryNodes](const int32_t idx) {
+        const float(&bounds)[2][3] = binaryNodes[idx].bounds;
+        const float dx = bounds[1][0] - bounds[0][0];
+        const float dy = bounds[1][1] - bounds[0][1];
+        const float dz = bounds[1][2] - bounds[0][2];
+        return 2 * (dx * dy + dx * dz + dy * dz);
+    };
+
+    // replace the interior child with the largest surface area by its two children until the
+    // node is full, the children with large area are the most likely to be hit
+    int32_t binaryChildren[Width];
+    int32_t numChildren = 2;
+    binaryChildren[0] = binaryNodeIdx + 1;
+    binaryChildren[1] = binaryNodes[binaryNodeIdx].secondChildIdx();
+    while (numChildren < Width) {
+        int32_t openIdx = -1;
+        float maxSurfaceArea = -Infinity;
+        for (int32_t i = 0; i < numChildren; i++) {
+            if (!binaryNodes[binaryChildren[i]].isLeaf() &&
+                nodeSurfaceArea(binaryChildren[i]) > maxSurfaceArea) {
+                maxSurfaceArea = nodeSurfaceArea(binaryChildren[i]);
+                openIdx = i;
+            }
+        }
+        if (openIdx == -1)
+            break;
+
+        const int32_t openedNodeIdx = binaryChildren[openIdx];
+        binaryChildren[openIdx] = openedNodeIdx + 1;
+        binaryChildren[numChildren++] = binaryNodes[openedNodeIdx].secondChildIdx();
+    }
+
+    return addNode(binaryNodes, binaryChildren, numChildren);
+}
+
+template <int32_t Width>
+int32_t WideBVH<Width>::addNode(const std::vector<BVHTree::Node>& binaryNodes,
+                                const int32_t* binaryChildren, const int32_t numChildren) {
+    const int32_t nodeIdx = (int32_t)nodes.size();
+    nodes.emplace_back();
+    for (int32_t i = 0; i < Width; i++) {
+        int32_t childRef = -1, numPrims = 0;
+        if (i < numChildren) {
+            const BVHTree::Node& binaryChild = binaryNodes[binaryChildren[i]];
+            if (binaryChild.isLeaf()) {
+                childRef = binaryChild.primsOffset();
+                numPrims = binaryChild.numPrims();
+            } else {
+                childRef = collapse(binaryNodes, binaryChildren[i]);
+            }
+        }
+
+        // the recursion above may reallocate the nodes, access the node only after it
+        Node& node = nodes[nodeIdx];
+        for (int32_t axis = 0; axis < 3; axis++) {
+            node.bounds[0][axis][i] =
+                i < numChildren ? binaryNodes[binaryChildren[i]].bounds[0][axis] : Infinity;
+            node.bounds[1][axis][i] =
+                i < numChildren ? binaryNodes[binaryChildren[i]].bounds[1][axis] : -Infinity;
+        }
+        node.children[i] = childRef;
+        node.numPrims[i] = numPrims;
+    }
+
+    return nodeIdx;
+}
+
+template <int32_t Width>
+int32_t WideBVH<Width>::intersectChildren(const Node& node, const RayData& rayData,
+                                          const float rayTMax, float* tNear) const {
+    // slab test of all children at once, the near and far planes are chosen by the direction
+    // signs. A NaN distance from a ray lying in a slab plane keeps the running range unchanged
+#if defined(__AVX2__)
+    if constexpr (Width == 8) {
+        __m256 tMin = _mm256_setzero_ps();
+        __m256 tMax = _mm256_set1_ps(rayTMax);
+        for (int32_t axis = 0; axis < 3; axis++) {
+            const __m256 origin = _mm256_set1_ps(rayData.origin[axis]);
+            const __m256 invDir = _mm256_set1_ps(rayData.invDir[axis]);
+            const __m256 nearBounds = _mm256_load_ps(node.bounds[rayData.dirIsNeg[axis]][axis]);
+            const __m256 farBounds = _mm256_load_ps(node.bounds[1 - rayData.dirIsNeg[axis]][axis]);
+            const __m256 tNearAxis = _mm256_mul_ps(_mm256_sub_ps(nearBounds, origin), invDir);
+            const __m256 tFarAxis =
+                _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(farBounds, origin), invDir),
+                              _mm256_set1_ps(1 + 2 * gamma(3)));
+            tMin = _mm256_max_ps(tNearAxis, tMin);
+            tMax = _mm256_min_ps(tFarAxis, tMax);
+        }
+        _mm256_storeu_ps(tNear, tMin);
+        return _mm256_movemask_ps(_mm256_cmp_ps(tMin, tMax, _CMP_LE_OQ));
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    // without AVX2 the 8 children are tested as two groups of 4
+    if constexpr (Width % 4 == 0) {
+        int32_t hitMask = 0;
+        for (int32_t group = 0; group < Width; group += 4) {
+            __m128 tMin = _mm_setzero_ps();
+            __m128 tMax = _mm_set1_ps(rayTMax);
+            for (int32_t axis = 0; axis < 3; axis++) {
+                const __m128 origin = _mm_set1_ps(rayData.origin[axis]);
+                const __m128 invDir = _mm_set1_ps(rayData.invDir[axis]);
+                const __m128 nearBounds =
+                    _mm_load_ps(node.bounds[rayData.dirIsNeg[axis]][axis] + group);
+                const __m128 farBounds =
+                    _mm_load_ps(node.bounds[1 - rayData.dirIsNeg[axis]][axis] + group);
+                const __m128 tNearAxis = _mm_mul_ps(_mm_sub_ps(nearBounds, origin), invDir);
+                const __m128 tFarAxis =
+                    _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(farBounds, origin), invDir),
+                               _mm_set1_ps(1 + 2 * gamma(3)));
+                tMin = _mm_max_ps(tNearAxis, tMin);
+                tMax = _mm_min_ps(tFarAxis, tMax);
+            }
+            _mm_storeu_ps(tNear + group, tMin);
+            hitMask |= _mm_movemask_ps(_mm_cmple_ps(tMin, tMax)) << group;
+        }
+        return hitMask;
+    }
+#endif
+
+    // scalar fallback
+    float tMin[Width], tMax[Width];
+    for (int32_t i = 0; i < Width; i++) {
+        tMin[i] = 0;
+        tMax[i] = rayTMax;
+    }
+    for (int32_t axis = 0; axis < 3; axis++) {
+        const float* nearBounds = node.bounds[rayData.dirIsNeg[axis]][axis];
+        const float* farBounds = node.bounds[1 - rayData.dirIsNeg[axis]][axis];
+        for (int32_t i = 0; i < Width; i++) {
+            const float tNearAxis = (nearBounds[i] - rayData.origin[axis]) * rayData.invDir[axis];
+            float tFarAxis = (farBounds[i] - rayData.origin[axis]) * rayData.invDir[axis];
+            tFarAxis *= 1 + 2 * gamma(3);  // Update tFar to ensure robust ray–bbox intersection
+            tMin[i] = tNearAxis > tMin[i] ? tNearAxis : tMin[i];
+            tMax[i] = tFarAxis < tMax[i] ? tFarAxis : tMax[i];
+        }
+    }
+
+    int32_t hitMask = 0;
+    for (int32_t i = 0; i < Width; i++) {
+        tNear[i] = tMin[i];
+        if (tMin[i] <= tMax[i])
+            hitMask |= 1 << i;
+    }
+    return hitMask;
+}
+
+template <int32_t Width>
+template <typename LeafVisitor>
+bool WideBVH<Width>::traverse(const Ray& ray, LeafVisitor&& visitLeaf) const {
+    if (nodes.empty())
+        return false;
+
+    RayData rayData;
+    rayData.origin = ray.origin;
+    rayData.invDir = Vector3f(1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z);
+    for (int32_t axis = 0; axis < 3; axis++)
+        rayData.dirIsNeg[axis] = rayData.invDir[axis] < 0;
+
+    FixedStack<StackEntry, Width * BVH_MAX_DEPTH> nodesStack;
+    nodesStack.push({0, 0, 0.f});
+    while (!nodesStack.empty()) {
+        // skip the children that start behind the closest hit found after they were stacked
+        const StackEntry entry = nodesStack.pop();
+        if (entry.tNear > ray.tMax)
+            continue;
+
+        if (entry.numPrims > 0) {
+            if (visitLeaf(entry.childRef, entry.numPrims))
+                return true;
+            continue;
+        }
+
+        const Node& node = nodes[entry.childRef];
+        float tNear[Width];
+        const int32_t hitMask = intersectChildren(node, rayData, ray.tMax, tNear);
+
+        // stack the hit children from the farthest to the nearest so the nearest is visited next
+        StackEntry hitChildren[Width];
+        int32_t numHits = 0;
+        for (int32_t i = 0; i < Width; i++) {
+            if (!(hitMask & (1 << i)))
+                continue;
+            int32_t pos = numHits++;
+            for (; pos > 0 && hitChildren[pos - 1].tNear < tNear[i]; pos--)
+                hitChildren[pos] = hitChildren[pos - 1];
+            hitChildren[pos] = {node.children[i], node.numPrims[i], tNear[i]};
+        }
+        for (int32_t i = 0; i < numHits; i++)
+            nodesStack.push(hitChildren[i]);
+    }
+
+    return false;
+}
+
+template <int32_t Width>
+bool WideBVH<Width>::intersect(const Ray& ray, Intersection& isectData) const {
+    const TriangleIntersector intersector(ray, isectMethod);
+    TriangleHit closestHit;
+    traverse(ray, [&](const int32_t primsOffset, const int32_t numPrims) -> bool {
+        // search for the closest intersection with the leaf's triangles
+        for (int32_t i = primsOffset; i < primsOffset + numPrims; ++i) {
+            float t, u, v;
+            if (intersector.intersect(triangleRecords[i], t, u, v) && t < closestHit.t) {
+                closestHit = {t, u, v, i};
+                ray.tMax = t;
+            }
+        }
+        return false;
+    });
+
+    // the hit attributes are computed only for the closest triangle
+    if (closestHit.primIdx < 0)
+        return false;
+
+    const int32_t primIdx = closestHit.primIdx;
+    triangles[primIdx].computeIntersection(ray, closestHit.t, closestHit.u, closestHit.v,
+                                           isectData);
+    return true;
+}
+
+template <int32_t Width>
+bool WideBVH<Width>::occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const {
+    // stop on the first opaque triangle hit, the material is looked up only for the hits
+    const TriangleIntersector intersector(ray, isectMethod);
+    return traverse(ray, [&](const int32_t primsOffset, const int32_t numPrims) -> bool {
+        for (int32_t i = primsOffset; i < primsOffset + numPrims; ++i) {
+            float t, u, v;
+            if (intersector.intersect(triangleRecords[i], t, u, v) &&
+                isOpaque(opaqueMaterials, triangles[i].mesh->materialIdx))
+                return true;
+        }
+        return false;
+    });
+}
+
+template <int32_t Width>
+void WideBVH<Width>::setTriangleIntersection(const TriangleIntersection method) {
+    if (method == isectMethod)
+        return;
+
+    Accelerator::setTriangleIntersection(method);
+    for (size_t i = 0; i < triangles.size(); i++)
+        triangleRecords[i] = TriangleRecord(triangles[i], method);
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
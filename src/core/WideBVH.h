@@ -0,0 +1,77 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include "BVH.h"
+
+/// @brief Multi-branch BVH with _Width_ (4 or 8) children per node, obtained by collapsing the
+/// binary BVH. The children's bounds are kept in SoA layout so that SSE tests 4 children of a
+/// node against the ray at once. The default build tests the 8 children as two 4-wide SSE groups,
+/// a single AVX2 kernel is used only when built with CRT_ENABLE_AVX2, and scalar code only
+/// without SSE2
+template <int32_t Width>
+class WideBVH : public Accelerator {
+    static_assert(Width == 4 || Width == 8, "WideBVH supports 4 and 8 children per node");
+
+private:
+    /// @brief Node with the bounds of its children stored per corner and axis. Interior children
+    /// reference a node, leaf children reference a range of the triangles and empty slots have
+    /// inverted bounds that are never hit
+    struct alignas(32) Node {
+        float bounds[2][3][Width];  ///< Minimum and maximum corners of the children per axis
+        int32_t children[Width];    ///< Interior child: node index, leaf child: triangles offset
+        int32_t numPrims[Width];    ///< Number of triangles of leaf children, 0 otherwise
+    };
+
+    /// @brief Child scheduled for traversal along with the ray distance to its bounds
+    struct StackEntry {
+        int32_t childRef;  ///< Node index or triangles offset of the child
+        int32_t numPrims;  ///< Number of triangles if the child is leaf, 0 otherwise
+        float tNear;       ///< Distance along the ray to the entry point of the child's bounds
+    };
+
+    /// @brief Ray data shared by the box tests of a traversal
+    struct RayData {
+        Point3f origin;   ///< Origin of the ray
+        Vector3f invDir;  ///< Reciprocal direction of the ray
+        int dirIsNeg[3];  ///< Whether the direction is negative per axis
+    };
+
+public:
+    /// @brief Collapses _binaryBVH_ into a BVH with _Width_ children per node, taking over its
+    /// triangles and their records
+    explicit WideBVH(BVH&& binaryBVH);
+
+    bool intersect(const Ray& ray, Intersection& isectData) const override;
+
+    bool occluded(const Ray& ray, const OpaqueMaterials& opaqueMaterials) const override;
+
+    void setTriangleIntersection(const TriangleIntersection method) override;
+
+private:
+    /// @brief Walks the nodes overlapped by _ray_, visiting the nearest children first, and
+    /// calls _visitLeaf_ for each reached leaf. Stops and returns true as soon as _visitLeaf_
+    /// returns true
+    template <typename LeafVisitor>
+    bool traverse(const Ray& ray, LeafVisitor&& visitLeaf) const;
+
+    /// @brief Tests all children of _node_ against the segment [0, _rayTMax_] of the ray.
+    /// Returns bitmask of the hit children and records their entry distances in _tNear_
+    int32_t intersectChildren(const Node& node, const RayData& rayData, const float rayTMax,
+                              float* tNear) const;
+
+    /// @brief Creates node from the interior node _binaryNodeIdx_ of _binaryNodes_ by opening
+    /// its largest descendants until _Width_ children are gathered. Returns index of the node
+    int32_t collapse(const std::vector<BVHTree::Node>& binaryNodes, const int32_t binaryNodeIdx);
+
+    /// @brief Appends node whose children are the _numChildren_ nodes _binaryChildren_ of
+    /// _binaryNodes_, collapsing the interior ones recursively. Returns index of the node
+    int32_t addNode(const std::vector<BVHTree::Node>& binaryNodes, const int32_t* binaryChildren,
+                    const int32_t numChildren);
+
+private:
+    std::vector<Node> nodes;                      ///< Flattened nodes of the BVH, the root is first
+    std::vector<Triangle> triangles;              ///< Triangles ordered by the leaves
+    std::vector<TriangleRecord> triangleRecords;  ///< Intersection records of the triangles
+};
+
+#endif  // !WIDEBVH_H
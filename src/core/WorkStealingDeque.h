@@ -0,0 +1,121 @@
+#ifndef WORKSTEALINGDEQUE_H
+#define WORKSTEALINGDEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Defines.h"
+
+/// @brief Chase-Lev work-stealing deque of pointers. The owner thread pushes and pops items at
+/// the bottom without locking, while any other thread may steal the oldest item from the top.
+/// Follows the C11 formulation of Le et al. "Correct and Efficient Work-Stealing for Weak
+/// Memory Models". The storage grows when full, the replaced buffers are kept alive until the
+/// deque is destroyed because thieves may still read them
+template <typename T>
+class WorkStealingDeque {
+private:
+    /// @brief Circular array of the items, indexed by the unbounded top and bottom positions
+    struct Buffer {
+        explicit Buffer(const int64_t _capacity)
+            : capacity(_capacity), items(new std::atomic<T*>[_capacity]) {}
+
+        T* get(const int64_t idx) const {
+            return items[idx & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(const int64_t idx, T* item) {
+            items[idx & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+
+        const int64_t capacity;                    ///< Number of slots, power of two
+        std::unique_ptr<std::atomic<T*>[]> items;  ///< The slots
+    };
+
+public:
+    explicit WorkStealingDeque(const int64_t initialCapacity = TASK_DEQUE_INITIAL_CAPACITY) {
+        Assert((initialCapacity & (initialCapacity - 1)) == 0 &&
+               "Deque capacity must be power of two");
+        buffers.push_back(std::make_unique<Buffer>(initialCapacity));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /// @brief Pushes _item_ at the bottom. Called only by the owner
+    void push(T* item) {
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        const int64_t t = top.load(std::memory_order_acquire);
+        Buffer* buf = buffer.load(std::memory_order_relaxed);
+        if (b - t > buf->capacity - 1)
+            buf = grow(buf, t, b);
+
+        buf->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /// @brief Pops the newest item from the bottom. Called only by the owner. Returns nullptr if
+    /// the deque is empty or the last item was stolen meanwhile
+    T* pop() {
+        const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buf = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {  // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* item = buf->get(b);
+        if (t == b) {  // the last item, races with the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                item = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /// @brief Steals the oldest item from the top. Safe to call from any thread. Returns nullptr
+    /// if the deque is empty or another thread took the item first
+    T* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        T* item = buffer.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    /// @brief Approximate number of items, exact only when no other thread uses the deque
+    int64_t size() const {
+        return bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+    }
+
+private:
+    /// @brief Moves the items in [_t_, _b_) of _buf_ into a buffer twice as large and publishes it
+    Buffer* grow(const Buffer* buf, const int64_t t, const int64_t b) {
+        buffers.push_back(std::make_unique<Buffer>(buf->capacity * 2));
+        Buffer* newBuf = buffers.back().get();
+        for (int64_t i = t; i < b; i++)
+            newBuf->put(i, buf->get(i));
+        buffer.store(newBuf, std::memory_order_release);
+        return newBuf;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};       ///< Position of the oldest item
+    alignas(64) std::atomic<int64_t> bottom{0};    ///< Position after the newest item
+    std::atomic<Buffer*> buffer;                   ///< Current storage of the items
+    std::vector<std::unique_ptr<Buffer>> buffers;  ///< All allocated storages, the last is current
+};
+
+#endif  // !WORKSTEALINGDEQUE_H
@@ -2,6 +2,7 @@
 #include "core/Scene.h"
 #include "core/Statistics.h"
 #include "core/ThreadPool.h"
+#include "core/TileCostMap.h"
 #include "core/Timer.h"
 
 static int32_t runRenderer(const std::string& inputFile, ThreadPool& pool,
@@ -15,24 +16,53 @@ static int32_t runRenderer(const std::string& inputFile, ThreadPool& pool,
     }
 
     // initialize scene
-    Scene scene(sceneParams);
+    Scene scene(std::move(sceneParams));
 
-    // initialize image
+    // initialize two images, so the previous frame is encoded while the next one renders
     const SceneDimensions dimens = scene.getSceneDimensions();
-    PPMImageI ppmImage(dimens.width, dimens.height);
+    PPMImageI ppmImages[2]{PPMImageI(dimens.width, dimens.height),
+                           PPMImageI(dimens.width, dimens.height)};
 
-    // initialize renderer
-    Renderer renderer(ppmImage, &scene);
+    // initialize a renderer per image
+    Renderer renderers[2]{Renderer(ppmImages[0], &scene), Renderer(ppmImages[1], &scene)};
     settings.numPixelsPerThread = scene.getSceneSettings().bucketSize;
+    settings.tileOrder = scene.getSceneSettings().tileOrder;
+    settings.adaptiveTiles = scene.getSceneSettings().adaptiveTiles;
+
+    // render cost of the previous frame that the adaptive tiles are fitted to
+    TileCostMap tileCosts(dimens.width, dimens.height);
 
     // camera pos to take an image from
     const std::vector<Vector3f> cameraPosVec{Vector3f{0.f, 14.f, 26.f}, Vector3f{0.f, 6.f, 10.f},
                                              Vector3f{4.f, 6.f, 10.f},  Vector3f{0.f, 6.f, -10.f},
                                              Vector3f{4.f, 6.f, -10.f}, Vector3f{-14.f, 14.f, 0.f}};
 
+    // returns the encoding time in milliseconds
+    auto encodeFrame = [&](const int32_t frameIdx) {
+        Timer encodeTimer;
+        encodeTimer.start();
+        serializePPMImage2PNG(ppmFileName + std::to_string(frameIdx) + ".jpg",
+                              ppmImages[frameIdx % 2]);
+        return Timer::toMilliSec<float>(encodeTimer.getElapsedNanoSec());
+    };
+
+    // the workers time their work from their first task until completeTasks(), so the work done
+    // on the pool outside the frames is reported on its own to keep it out of the frame times
+    auto reportPhaseStatistics = [&pool](const char* phase) {
+        std::cout << phase << " worker statistics:\n";
+        pool.completeTasks();
+        flushStatistics();
+    };
+
     std::cout << "Loading " << ppmFileName << ".crtscene ...\n";
-    scene.createAccelTree();
+    scene.createAccelTree(&pool);
+    reportPhaseStatistics("Acceleration structure build");
+    TaskGroup frameTasks;
     for (int32_t i = 0; i < (int32_t)cameraPosVec.size(); i++) {
+        // the previous frame finished rendering, so the moving objects can take their next step
+        if (i > 0 && scene.animateObjects(&pool))
+            reportPhaseStatistics("Animation update");
+
         // set camera position and target
         Camera& sceneCamera = scene.getCamera();
         sceneCamera.setLookFrom(cameraPosVec[i]);
@@ -42,26 +72,56 @@ static int32_t runRenderer(const std::string& inputFile, ThreadPool& pool,
         Timer timer;
         timer.start();
 
+        Renderer& renderer = renderers[i % 2];
 #ifdef RENDER_STATIC
         for (size_t threadId = 0; threadId < settings.numThreads; threadId++) {
             auto renderTask = std::bind(&Renderer::renderStatic, &renderer, threadId,
                                         settings.numThreads, settings.numPixelsPerThread);
-            pool.scheduleTask(renderTask);
+            pool.scheduleTask(frameTasks, renderTask);
         }
 #else
-        using namespace std::placeholders;
-        auto renderTask = std::bind(&Renderer::renderRegion, &renderer, _1, _2, _3, _4);
-        pool.parallelLoop2D(renderTask, (size_t)dimens.width, (size_t)dimens.height,
-                            settings.numPixelsPerThread, settings.numPixelsPerThread);
+        if (settings.adaptiveTiles) {
+            auto renderTask = [&renderer, &tileCosts](const size_t x0, const size_t x1,
+                                                      const size_t y0, const size_t y1) {
+                Timer tileTimer;
+                tileTimer.start();
+                renderer.renderRegion((int32_t)x0, (int32_t)x1, (int32_t)y0, (int32_t)y1);
+                tileCosts.recordTileCost({x0, x1, y0, y1}, tileTimer.getElapsedNanoSec());
+            };
+            pool.parallelTiles(frameTasks, renderTask,
+                               tileCosts.computeTiles(settings.numPixelsPerThread,
+                                                      settings.tileOrder));
+        } else {
+            using namespace std::placeholders;
+            auto renderTask = std::bind(&Renderer::renderRegion, &renderer, _1, _2, _3, _4);
+            pool.parallelLoop2D(frameTasks, renderTask, (size_t)dimens.width,
+                                (size_t)dimens.height, settings.numPixelsPerThread,
+                                settings.numPixelsPerThread, settings.tileOrder);
+        }
 #endif
+        const float encodeMs = i > 0 ? encodeFrame(i - 1) : 0.f;
+
+        frameTasks.wait();
+        // returns as soon as the workers report their statistics of the frame
         pool.completeTasks();
 
+        // the previous frame is encoded on this thread while the frame renders, so the frame
+        // time covers the encoding too if it takes longer than rendering
         std::cout << ppmFileName << i << " data generated in [" << std::fixed
                   << std::setprecision(2) << Timer::toMilliSec<float>(timer.getElapsedNanoSec())
-                  << "ms] on " << settings.numThreads << " threads\n";
+                  << "ms] on " << settings.numThreads << " threads";
+        if (i > 0)
+            std::cout << ", the time covers encoding " << ppmFileName << i - 1 << " in ["
+                      << encodeMs << "ms] alongside";
+        std::cout << "\n";
 
         flushStatistics();
-        serializePPMImage2PNG(ppmFileName + std::to_string(i) + ".jpg", ppmImage);
+    }
+
+    if (!cameraPosVec.empty()) {
+        const int32_t lastFrameIdx = (int32_t)cameraPosVec.size() - 1;
+        const float encodeMs = encodeFrame(lastFrameIdx);
+        std::cout << ppmFileName << lastFrameIdx << " encoded in [" << encodeMs << "ms]\n";
     }
 
     return EXIT_SUCCESS;
@@ -77,6 +137,7 @@ int main() {
     for (const auto& file : inputFiles) {
         if (runRenderer(file, pool, renderSettings) != EXIT_SUCCESS) {
             std::cerr << "Failed to render file - " << file << std::endl;
+            pool.stop();
             return EXIT_FAILURE;
         }
     }